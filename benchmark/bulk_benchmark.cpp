@@ -0,0 +1,424 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Measures bulk transfer throughput and small message latency of
+// wintls::stream compared to asio::ssl::stream, both running over
+// in-memory test streams.
+//
+// Usage: bulk_benchmark [--loopback] [--json] [--size bytes]... [--total bytes] [--pings n]
+//
+// Each --size option adds a message size to transfer. Defaults to a
+// range of sizes from 64 bytes to 16 MiB. Messages of each size are
+// transferred until at least --total bytes have been sent, with both
+// the synchronous and asynchronous operations.
+//
+// For each run the throughput and the number of TLS records per
+// write to the next layer is reported. When built with
+// WINTLS_ENABLE_STATISTICS, the number of times each byte is copied
+// by the wintls streams, as counted by stream::statistics, is
+// reported as well. Small message latency is
+// measured as the round trip time of --pings request/response pairs
+// of 64 bytes.
+//
+// With --json the results are written as a JSON array to stdout for
+// tracking regressions.
+
+#include "common.hpp"
+#include "asio_ssl_client_stream.hpp"
+#include "asio_ssl_server_stream.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr std::size_t ping_size = 64;
+
+struct options {
+  bool use_loopback = false;
+  bool json = false;
+  std::vector<std::size_t> sizes;
+  std::size_t total = 0x4000000;
+  std::size_t pings = 10000;
+};
+
+// Forwards all operations to the next layer while counting the writes
+// and the TLS records written. Assumes every write is completed in
+// full, which is always the case for the test streams.
+template <class NextLayer>
+class counting_stream {
+public:
+  using next_layer_type = typename std::remove_reference<NextLayer>::type;
+  using lowest_layer_type = next_layer_type;
+  using executor_type = typename next_layer_type::executor_type;
+
+  template <class Arg>
+  explicit counting_stream(Arg&& arg)
+    : next_layer_(std::forward<Arg>(arg)) {
+  }
+
+  executor_type get_executor() {
+    return next_layer_.get_executor();
+  }
+
+  next_layer_type& next_layer() {
+    return next_layer_;
+  }
+
+  // Required by asio::ssl::stream
+  lowest_layer_type& lowest_layer() {
+    return next_layer_;
+  }
+
+  const lowest_layer_type& lowest_layer() const {
+    return next_layer_;
+  }
+
+  template <class MutableBufferSequence>
+  std::size_t read_some(const MutableBufferSequence& buffers) {
+    return next_layer_.read_some(buffers);
+  }
+
+  template <class MutableBufferSequence>
+  std::size_t read_some(const MutableBufferSequence& buffers, wintls::error_code& ec) {
+    return next_layer_.read_some(buffers, ec);
+  }
+
+  template <class MutableBufferSequence, class ReadHandler>
+  auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+    return next_layer_.async_read_some(buffers, std::forward<ReadHandler>(handler));
+  }
+
+  template <class ConstBufferSequence>
+  std::size_t write_some(const ConstBufferSequence& buffers) {
+    count(buffers);
+    return next_layer_.write_some(buffers);
+  }
+
+  template <class ConstBufferSequence>
+  std::size_t write_some(const ConstBufferSequence& buffers, wintls::error_code& ec) {
+    count(buffers);
+    return next_layer_.write_some(buffers, ec);
+  }
+
+  template <class ConstBufferSequence, class WriteHandler>
+  auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+    count(buffers);
+    return next_layer_.async_write_some(buffers, std::forward<WriteHandler>(handler));
+  }
+
+  std::size_t writes = 0;
+  std::size_t records = 0;
+
+private:
+  static constexpr std::size_t header_size = 5;
+
+  template <class ConstBufferSequence>
+  void count(const ConstBufferSequence& buffers) {
+    ++writes;
+    const auto end = net::buffer_sequence_end(buffers);
+    for (auto it = net::buffer_sequence_begin(buffers); it != end; ++it) {
+      net::const_buffer buffer(*it);
+      while (buffer.size() > 0) {
+        if (record_remaining_ > 0) {
+          const auto size = std::min(record_remaining_, buffer.size());
+          record_remaining_ -= size;
+          buffer += size;
+          continue;
+        }
+        header_[header_size_++] = *static_cast<const unsigned char*>(buffer.data());
+        buffer += 1;
+        if (header_size_ == header_size) {
+          record_remaining_ = static_cast<std::size_t>(header_[3]) << 8 | header_[4];
+          header_size_ = 0;
+          ++records;
+        }
+      }
+    }
+  }
+
+  NextLayer next_layer_;
+  unsigned char header_[header_size] = {};
+  std::size_t header_size_ = 0;
+  std::size_t record_remaining_ = 0;
+};
+
+using counting_test_stream = counting_stream<test_stream>;
+
+struct result {
+  std::string implementation;
+  std::string mode;
+  std::size_t size;
+  std::size_t messages;
+  double mib_per_s;
+  double records_per_write;
+  // Only known for wintls streams collecting statistics
+  bool copies_counted;
+  double copies_per_byte;
+};
+
+struct latency {
+  std::string implementation;
+  std::string mode;
+  std::size_t pings;
+  double p50_us;
+  double p99_us;
+  double p999_us;
+};
+
+// Plaintext bytes copied by a stream or, unless the stream collects
+// statistics, zero
+template <class NextLayer>
+std::uint64_t bytes_copied(const wintls::stream<NextLayer>& stream) {
+  return stream.statistics().plaintext_bytes_copied;
+}
+
+template <class Stream>
+std::uint64_t bytes_copied(const Stream&) {
+  return 0;
+}
+
+template <class NextLayer>
+bool copies_counted(const wintls::stream<NextLayer>&) {
+#ifdef WINTLS_ENABLE_STATISTICS
+  return true;
+#else // WINTLS_ENABLE_STATISTICS
+  return false;
+#endif // !WINTLS_ENABLE_STATISTICS
+}
+
+template <class Stream>
+bool copies_counted(const Stream&) {
+  return false;
+}
+
+template <class Client, class Server, class HandshakeType>
+bool handshake(net::io_context& ioc, Client& client, Server& server, HandshakeType client_type, HandshakeType server_type) {
+  client.next_layer().next_layer().connect(server.next_layer().next_layer());
+
+  wintls::error_code client_ec{};
+  wintls::error_code server_ec{};
+  client.async_handshake(client_type, [&client_ec](const wintls::error_code& ec) {
+    client_ec = ec;
+  });
+  server.async_handshake(server_type, [&server_ec](const wintls::error_code& ec) {
+    server_ec = ec;
+  });
+  ioc.run();
+  ioc.restart();
+
+  if (client_ec || server_ec) {
+    std::cerr << "Handshake failed: " << (client_ec ? client_ec : server_ec).message() << "\n";
+    return false;
+  }
+  return true;
+}
+
+template <class Client, class Server>
+void transfer(net::io_context& ioc, bool async, Client& client, Server& server,
+              const std::string& message, std::string& received) {
+  if (!async) {
+    net::write(client, net::buffer(message));
+    net::read(server, net::buffer(received));
+    return;
+  }
+  net::async_write(client, net::buffer(message), [](const wintls::error_code& ec, std::size_t) {
+    if (ec) {
+      throw wintls::system_error(ec);
+    }
+  });
+  net::async_read(server, net::buffer(received), [](const wintls::error_code& ec, std::size_t) {
+    if (ec) {
+      throw wintls::system_error(ec);
+    }
+  });
+  ioc.run();
+  ioc.restart();
+}
+
+template <class Client, class Server>
+result bulk(net::io_context& ioc, const std::string& implementation, bool async, Client& client, Server& server,
+            std::size_t size, const options& opts) {
+  const std::string message(size, 'x');
+  std::string received(size, '\0');
+  const auto messages = std::max<std::size_t>(1, opts.total / size);
+
+  const auto writes = client.next_layer().writes;
+  const auto records = client.next_layer().records;
+  const auto copied = bytes_copied(client) + bytes_copied(server);
+  const auto start = clock_type::now();
+  for (std::size_t i = 0; i < messages; ++i) {
+    transfer(ioc, async, client, server, message, received);
+  }
+  const auto elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+  const auto total_writes = client.next_layer().writes - writes;
+  const auto total_records = client.next_layer().records - records;
+  const auto total_copied = bytes_copied(client) + bytes_copied(server) - copied;
+
+  return {implementation, async ? "async" : "sync", size, messages,
+          static_cast<double>(size * messages) / elapsed / (1024 * 1024),
+          static_cast<double>(total_records) / static_cast<double>(std::max<std::size_t>(1, total_writes)),
+          copies_counted(client),
+          static_cast<double>(total_copied) / static_cast<double>(size * messages)};
+}
+
+double percentile_us(const std::vector<clock_type::duration>& sorted, double percentile) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  const auto rank = static_cast<std::size_t>(std::ceil(percentile * static_cast<double>(sorted.size())));
+  const auto index = std::min(sorted.size() - 1, rank == 0 ? 0 : rank - 1);
+  return std::chrono::duration<double, std::micro>(sorted[index]).count();
+}
+
+template <class Client, class Server>
+latency ping(net::io_context& ioc, const std::string& implementation, bool async, Client& client, Server& server,
+             const options& opts) {
+  const std::string request(ping_size, 'q');
+  std::string response(ping_size, '\0');
+  std::string received(ping_size, '\0');
+
+  std::vector<clock_type::duration> latencies;
+  latencies.reserve(opts.pings);
+  for (std::size_t i = 0; i < opts.pings; ++i) {
+    const auto start = clock_type::now();
+    transfer(ioc, async, client, server, request, response);
+    transfer(ioc, async, server, client, response, received);
+    latencies.push_back(clock_type::now() - start);
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  return {implementation, async ? "async" : "sync", opts.pings,
+          percentile_us(latencies, 0.50), percentile_us(latencies, 0.99), percentile_us(latencies, 0.999)};
+}
+
+template <class Client, class Server>
+void run_all(net::io_context& ioc, const std::string& implementation, Client& client, Server& server,
+             const options& opts, std::vector<result>& results, std::vector<latency>& latencies) {
+  for (const bool async : {false, true}) {
+    for (const auto size : opts.sizes) {
+      results.push_back(bulk(ioc, implementation, async, client, server, size, opts));
+    }
+    latencies.push_back(ping(ioc, implementation, async, client, server, opts));
+  }
+}
+
+void print_text(const std::vector<result>& results, const std::vector<latency>& latencies) {
+  for (const auto& r : results) {
+    std::cout << r.implementation << " " << r.mode << " " << r.size << " bytes x " << r.messages << ": "
+              << r.mib_per_s << " MiB/s, " << r.records_per_write << " records/write";
+    if (r.copies_counted) {
+      std::cout << ", " << r.copies_per_byte << " copies/byte";
+    }
+    std::cout << "\n";
+  }
+  for (const auto& l : latencies) {
+    std::cout << l.implementation << " " << l.mode << " ping (" << l.pings << "): p50 " << l.p50_us
+              << " us, p99 " << l.p99_us << " us, p999 " << l.p999_us << " us\n";
+  }
+}
+
+void print_json(const std::string& provider, const std::vector<result>& results, const std::vector<latency>& latencies) {
+  std::cout << "[\n";
+  bool first = true;
+  auto separator = [&first]() {
+    std::cout << (first ? "" : ",\n");
+    first = false;
+  };
+  for (const auto& r : results) {
+    separator();
+    std::cout << "  {\"benchmark\": \"bulk\", \"implementation\": \"" << r.implementation << "\", "
+              << "\"provider\": \"" << (r.implementation == "wintls" ? provider : "openssl") << "\", "
+              << "\"mode\": \"" << r.mode << "\", \"size\": " << r.size << ", \"messages\": " << r.messages << ", "
+              << "\"mib_per_s\": " << r.mib_per_s << ", \"records_per_write\": " << r.records_per_write;
+    if (r.copies_counted) {
+      std::cout << ", \"copies_per_byte\": " << r.copies_per_byte;
+    }
+    std::cout << "}";
+  }
+  for (const auto& l : latencies) {
+    separator();
+    std::cout << "  {\"benchmark\": \"ping\", \"implementation\": \"" << l.implementation << "\", "
+              << "\"provider\": \"" << (l.implementation == "wintls" ? provider : "openssl") << "\", "
+              << "\"mode\": \"" << l.mode << "\", \"size\": " << ping_size << ", \"pings\": " << l.pings << ", "
+              << "\"p50_us\": " << l.p50_us << ", \"p99_us\": " << l.p99_us << ", \"p999_us\": " << l.p999_us << "}";
+  }
+  std::cout << "\n]\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  options opts;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--loopback") {
+      opts.use_loopback = true;
+    } else if (arg == "--json") {
+      opts.json = true;
+    } else if (arg == "--size" && i + 1 < argc) {
+      opts.sizes.push_back(std::max<std::size_t>(1, std::strtoul(argv[++i], nullptr, 10)));
+    } else if (arg == "--total" && i + 1 < argc) {
+      opts.total = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--pings" && i + 1 < argc) {
+      opts.pings = std::strtoul(argv[++i], nullptr, 10);
+    } else {
+      std::cerr << "Unknown argument: " << arg << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+  if (opts.sizes.empty()) {
+    opts.sizes = {64, 0x400, 0x4000, 0x10000, 0x100000, 0x1000000};
+  }
+
+  std::vector<result> results;
+  std::vector<latency> latencies;
+  try {
+    net::io_context ioc;
+
+    {
+      const benchmark::setup setup(opts.use_loopback);
+      auto client_ctx = setup.make_client_context();
+      auto server_ctx = setup.make_server_context();
+      wintls::stream<counting_test_stream> client(ioc, *client_ctx);
+      wintls::stream<counting_test_stream> server(ioc, *server_ctx);
+      if (!handshake(ioc, client, server, wintls::handshake_type::client, wintls::handshake_type::server)) {
+        return EXIT_FAILURE;
+      }
+      run_all(ioc, "wintls", client, server, opts, results, latencies);
+    }
+
+    {
+      asio_ssl_client_context client_ctx;
+      asio_ssl_server_context server_ctx;
+      asio_ssl::stream<counting_test_stream> client(ioc, client_ctx);
+      asio_ssl::stream<counting_test_stream> server(ioc, server_ctx);
+      if (!handshake(ioc, client, server, asio_ssl::stream_base::client, asio_ssl::stream_base::server)) {
+        return EXIT_FAILURE;
+      }
+      run_all(ioc, "asio_ssl", client, server, opts, results, latencies);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  if (opts.json) {
+    print_json(opts.use_loopback ? "loopback" : "schannel", results, latencies);
+  } else {
+    print_text(results, latencies);
+  }
+  return EXIT_SUCCESS;
+}
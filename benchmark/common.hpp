@@ -0,0 +1,78 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_BENCHMARK_COMMON_HPP
+#define WINTLS_BENCHMARK_COMMON_HPP
+
+#include <wintls.hpp>
+
+#ifndef WINTLS_USE_STANDALONE_ASIO
+#include <boost/beast/core.hpp>
+#endif // !WINTLS_USE_STANDALONE_ASIO
+
+#include "certificate.hpp"
+#include "loopback_provider.hpp"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace net = wintls::net;
+
+namespace benchmark {
+
+// Sets up either Schannel with the test certificate and private key
+// or the loopback provider for the lifetime of the object.
+class setup {
+public:
+  explicit setup(bool use_loopback)
+    : use_loopback_(use_loopback) {
+    if (use_loopback_) {
+      loopback_ = std::make_unique<wintls::test::loopback_provider::scoped_install>();
+      return;
+    }
+    wintls::error_code ec;
+    wintls::delete_private_key(key_name, ec);
+    wintls::import_private_key(net::buffer(test_key), wintls::file_format::pem, key_name, ec);
+    if (ec) {
+      throw std::runtime_error("Unable to import private key: " + ec.message());
+    }
+  }
+
+  setup(const setup&) = delete;
+  setup& operator=(const setup&) = delete;
+
+  ~setup() {
+    if (!use_loopback_) {
+      wintls::error_code ec;
+      wintls::delete_private_key(key_name, ec);
+    }
+  }
+
+  std::unique_ptr<wintls::context> make_server_context() const {
+    auto ctx = std::make_unique<wintls::context>(wintls::method::system_default);
+    if (use_loopback_) {
+      return ctx;
+    }
+    auto cert = wintls::x509_to_cert_context(net::buffer(test_certificate), wintls::file_format::pem);
+    wintls::assign_private_key(cert.get(), key_name);
+    ctx->use_certificate(cert.get());
+    return ctx;
+  }
+
+  std::unique_ptr<wintls::context> make_client_context() const {
+    return std::make_unique<wintls::context>(wintls::method::system_default);
+  }
+
+private:
+  static constexpr const char* key_name = "wintls-bench-key";
+
+  bool use_loopback_;
+  std::unique_ptr<wintls::test::loopback_provider::scoped_install> loopback_;
+};
+
+} // namespace benchmark
+
+#endif // WINTLS_BENCHMARK_COMMON_HPP
@@ -0,0 +1,150 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Measures the round trip latency of small messages exchanged between
+// two coroutines over in-memory test streams.
+//
+// Usage: coroutine_benchmark [--loopback] [--pings n] [--size bytes]
+//
+// Each message is read as a fixed size header followed by the rest of
+// the message, like most protocols do. As a message is always sent in
+// a single TLS record, the rest of the message has already been
+// decrypted when the header has been read. The reads are performed
+// with async_read_some and net::use_awaitable, both with the handlers
+// of such reads posted and with stream::set_immediate_completion.
+//
+// With --loopback the loopback provider is installed as the SSPI
+// function table instead of Schannel.
+
+#include "common.hpp"
+#include "test_stream/stream.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+using stream_type = wintls::stream<wintls::test::stream>;
+
+constexpr std::size_t header_size = 8;
+
+struct options {
+  bool use_loopback = false;
+  std::size_t pings = 100000;
+  std::size_t size = 64;
+};
+
+struct result {
+  std::vector<clock_type::duration> latencies;
+  double elapsed = 0.0;
+};
+
+net::awaitable<void> read_exactly(stream_type& stream, net::mutable_buffer buffer) {
+  while (buffer.size() > 0) {
+    buffer += co_await stream.async_read_some(buffer, net::use_awaitable);
+  }
+}
+
+net::awaitable<void> read_message(stream_type& stream, std::vector<char>& message) {
+  co_await read_exactly(stream, net::buffer(message.data(), header_size));
+  co_await read_exactly(stream, net::buffer(message) + header_size);
+}
+
+net::awaitable<void> server(stream_type& stream, const options& opts) {
+  co_await stream.async_handshake(wintls::handshake_type::server, net::use_awaitable);
+  std::vector<char> message(opts.size);
+  for (std::size_t i = 0; i < opts.pings; ++i) {
+    co_await read_message(stream, message);
+    co_await net::async_write(stream, net::buffer(message), net::use_awaitable);
+  }
+}
+
+net::awaitable<void> client(stream_type& stream, const options& opts, result& res) {
+  co_await stream.async_handshake(wintls::handshake_type::client, net::use_awaitable);
+  std::vector<char> message(opts.size, 'x');
+  const auto start = clock_type::now();
+  for (std::size_t i = 0; i < opts.pings; ++i) {
+    const auto ping_start = clock_type::now();
+    co_await net::async_write(stream, net::buffer(message), net::use_awaitable);
+    co_await read_message(stream, message);
+    res.latencies.push_back(clock_type::now() - ping_start);
+  }
+  res.elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+result run(const benchmark::setup& setup, const options& opts, bool immediate) {
+  net::io_context ioc;
+  auto server_ctx = setup.make_server_context();
+  auto client_ctx = setup.make_client_context();
+  stream_type server_stream(ioc, *server_ctx);
+  stream_type client_stream(ioc, *client_ctx);
+  client_stream.next_layer().connect(server_stream.next_layer());
+  server_stream.set_immediate_completion(immediate);
+  client_stream.set_immediate_completion(immediate);
+
+  result res;
+  res.latencies.reserve(opts.pings);
+  auto rethrow = [](std::exception_ptr e) {
+    if (e) {
+      std::rethrow_exception(e);
+    }
+  };
+  net::co_spawn(ioc, server(server_stream, opts), rethrow);
+  net::co_spawn(ioc, client(client_stream, opts, res), rethrow);
+  ioc.run();
+  return res;
+}
+
+double percentile_us(const std::vector<clock_type::duration>& sorted, double percentile) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  const auto rank = static_cast<std::size_t>(std::ceil(percentile * static_cast<double>(sorted.size())));
+  const auto index = std::min(sorted.size() - 1, rank == 0 ? 0 : rank - 1);
+  return std::chrono::duration<double, std::micro>(sorted[index]).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  options opts;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--loopback") {
+      opts.use_loopback = true;
+    } else if (arg == "--pings" && i + 1 < argc) {
+      opts.pings = std::max<std::size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--size" && i + 1 < argc) {
+      opts.size = std::max<std::size_t>(header_size, std::strtoul(argv[++i], nullptr, 10));
+    } else {
+      std::cerr << "Unknown argument: " << arg << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  try {
+    const benchmark::setup setup(opts.use_loopback);
+    for (const bool immediate : {false, true}) {
+      auto res = run(setup, opts, immediate);
+      std::sort(res.latencies.begin(), res.latencies.end());
+      std::cout << (immediate ? "immediate completion: " : "posted completion:    ") << res.latencies.size()
+                << " round trips of " << opts.size << " bytes, "
+                << static_cast<double>(res.latencies.size()) / res.elapsed << " round trips/s, p50 "
+                << percentile_us(res.latencies, 0.50) << " us, p99 " << percentile_us(res.latencies, 0.99)
+                << " us\n";
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
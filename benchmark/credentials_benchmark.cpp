@@ -0,0 +1,107 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Measures the handshake rate of streams sharing the credentials of a
+// single context compared to streams each acquiring their own
+// credentials by using a separate context per stream.
+//
+// Usage: credentials_benchmark [count] [--loopback]
+//
+// With --loopback the in-process loopback provider is used instead
+// of Schannel which isolates the overhead of the stream itself.
+
+#include "common.hpp"
+#include "test_stream/stream.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool handshake(net::io_context& ioc, wintls::context& client_ctx, wintls::context& server_ctx) {
+  wintls::stream<wintls::test::stream> client(ioc, client_ctx);
+  wintls::stream<wintls::test::stream> server(ioc, server_ctx);
+  client.next_layer().connect(server.next_layer());
+
+  wintls::error_code client_ec{};
+  wintls::error_code server_ec{};
+  client.async_handshake(wintls::handshake_type::client, [&client_ec](const wintls::error_code& ec) {
+    client_ec = ec;
+  });
+  server.async_handshake(wintls::handshake_type::server, [&server_ec](const wintls::error_code& ec) {
+    server_ec = ec;
+  });
+  ioc.run();
+  ioc.restart();
+
+  if (client_ec || server_ec) {
+    std::cerr << "Handshake failed: " << (client_ec ? client_ec : server_ec).message() << "\n";
+    return false;
+  }
+  return true;
+}
+
+void report(const std::string& name, std::size_t count, std::chrono::steady_clock::duration elapsed) {
+  const auto seconds = std::chrono::duration<double>(elapsed).count();
+  std::cout << name << ": " << count << " handshakes in " << seconds << " s ("
+            << static_cast<double>(count) / seconds << " handshakes/s)\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t count = 1000;
+  bool use_loopback = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--loopback") {
+      use_loopback = true;
+    } else {
+      count = std::strtoul(argv[i], nullptr, 10);
+    }
+  }
+
+  const benchmark::setup setup(use_loopback);
+  net::io_context ioc;
+  int result = EXIT_SUCCESS;
+
+  {
+    auto client_ctx = setup.make_client_context();
+    auto server_ctx = setup.make_server_context();
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < count; ++i) {
+      if (!handshake(ioc, *client_ctx, *server_ctx)) {
+        result = EXIT_FAILURE;
+        break;
+      }
+    }
+    report("shared credentials", count, std::chrono::steady_clock::now() - start);
+  }
+
+  {
+    // Contexts are created up front to only measure the cost of
+    // acquiring credentials as part of each handshake.
+    std::vector<std::unique_ptr<wintls::context>> client_ctxs;
+    std::vector<std::unique_ptr<wintls::context>> server_ctxs;
+    for (std::size_t i = 0; i < count; ++i) {
+      client_ctxs.push_back(setup.make_client_context());
+      server_ctxs.push_back(setup.make_server_context());
+    }
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < count; ++i) {
+      if (!handshake(ioc, *client_ctxs[i], *server_ctxs[i])) {
+        result = EXIT_FAILURE;
+        break;
+      }
+    }
+    report("per-stream credentials", count, std::chrono::steady_clock::now() - start);
+  }
+
+  return result;
+}
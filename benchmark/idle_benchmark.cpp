@@ -0,0 +1,268 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Measures the memory held by idle connections, like those of a
+// server waiting for requests from many mostly idle clients.
+//
+// Usage: idle_benchmark [--loopback] [--connections n]...
+//
+// Each --connections option adds a run with that number of
+// connections. Defaults to 10000, 100000 and 1000000 connections.
+//
+// The connections are established over in-memory test streams and
+// exchange a single small message in each direction, after which
+// both ends wait for more data. Each run is done with the streams
+// keeping their buffers and with the buffers released while idle
+// using stream::set_release_idle_buffers. The contexts share a
+// buffer pool, which is emptied before measuring so only the memory
+// held by the connections is reported.
+//
+// The memory is reported per connection, including both the client
+// and the server stream as well as the in-memory transport, as the
+// heap memory allocated with operator new and as the growth of the
+// working set of the process.
+//
+// With --loopback the loopback provider is installed as the SSPI
+// function table instead of Schannel.
+
+#include "common.hpp"
+#include "test_stream/stream.hpp"
+
+#include <windows.h>
+#include <psapi.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<std::size_t> heap_bytes{0};
+
+// Stores the size of each allocation in front of it, keeping the
+// alignment guaranteed by operator new
+constexpr std::size_t allocation_header_size = alignof(std::max_align_t);
+
+} // namespace
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size) {
+  auto ptr = static_cast<char*>(std::malloc(allocation_header_size + size));
+  if (ptr == nullptr) {
+    throw std::bad_alloc{};
+  }
+  *reinterpret_cast<std::size_t*>(ptr) = size;
+  heap_bytes.fetch_add(size, std::memory_order_relaxed);
+  return ptr + allocation_header_size;
+}
+
+void operator delete(void* ptr) noexcept {
+  if (ptr == nullptr) {
+    return;
+  }
+  auto block = static_cast<char*>(ptr) - allocation_header_size;
+  heap_bytes.fetch_sub(*reinterpret_cast<std::size_t*>(block), std::memory_order_relaxed);
+  std::free(block);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  operator delete(ptr);
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+namespace {
+
+using stream_type = wintls::stream<wintls::test::stream>;
+
+// Number of connections established at a time, limiting the memory
+// used by concurrent handshakes
+constexpr std::size_t batch_size = 1000;
+
+struct options {
+  bool use_loopback = false;
+  std::vector<std::size_t> connections;
+};
+
+struct result {
+  std::size_t heap_bytes = 0;
+  std::size_t resident_bytes = 0;
+};
+
+std::size_t working_set() {
+  PROCESS_MEMORY_COUNTERS counters{};
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return 0;
+  }
+  return counters.WorkingSetSize;
+}
+
+std::size_t per_connection(std::size_t before, std::size_t after, std::size_t connections) {
+  return after > before ? (after - before) / connections : 0;
+}
+
+void check(const wintls::error_code& ec) {
+  if (ec) {
+    throw std::runtime_error(ec.message());
+  }
+}
+
+// A client and a server stream exchanging a message in each direction
+// before waiting for more data
+class connection {
+public:
+  connection(net::io_context& ioc, wintls::context& server_ctx, wintls::context& client_ctx, bool release, std::size_t& idle)
+    : server_(ioc, server_ctx)
+    , client_(ioc, client_ctx)
+    , idle_(idle) {
+    client_.next_layer().connect(server_.next_layer());
+    server_.set_release_idle_buffers(release);
+    client_.set_release_idle_buffers(release);
+  }
+
+  connection(const connection&) = delete;
+  connection& operator=(const connection&) = delete;
+
+  void start() {
+    server_.async_handshake(wintls::handshake_type::server, [this](const wintls::error_code& ec) {
+      check(ec);
+      server_echo();
+    });
+    client_.async_handshake(wintls::handshake_type::client, [this](const wintls::error_code& ec) {
+      check(ec);
+      client_send();
+    });
+  }
+
+  // Closing the transport completes the reads waiting for data
+  void close() {
+    server_.next_layer().close();
+  }
+
+private:
+  using buffer_type = std::array<char, 64>;
+
+  void server_echo() {
+    net::async_read(server_, net::buffer(server_buffer_), [this](const wintls::error_code& ec, std::size_t) {
+      check(ec);
+      net::async_write(server_, net::buffer(server_buffer_), [this](const wintls::error_code& write_ec, std::size_t) {
+        check(write_ec);
+        wait(server_, server_buffer_);
+      });
+    });
+  }
+
+  void client_send() {
+    client_buffer_.fill('x');
+    net::async_write(client_, net::buffer(client_buffer_), [this](const wintls::error_code& ec, std::size_t) {
+      check(ec);
+      net::async_read(client_, net::buffer(client_buffer_), [this](const wintls::error_code& read_ec, std::size_t) {
+        check(read_ec);
+        wait(client_, client_buffer_);
+      });
+    });
+  }
+
+  void wait(stream_type& stream, buffer_type& buffer) {
+    ++idle_;
+    stream.async_read_some(net::buffer(buffer), [](const wintls::error_code&, std::size_t) {});
+  }
+
+  stream_type server_;
+  stream_type client_;
+  std::size_t& idle_;
+  buffer_type server_buffer_{};
+  buffer_type client_buffer_{};
+};
+
+result run(const benchmark::setup& setup, std::size_t count, bool release) {
+  net::io_context ioc;
+  auto pool = std::make_shared<wintls::buffer_pool>();
+  auto server_ctx = setup.make_server_context();
+  auto client_ctx = setup.make_client_context();
+  server_ctx->use_buffer_pool(pool);
+  client_ctx->use_buffer_pool(pool);
+
+  std::vector<std::unique_ptr<connection>> connections;
+  connections.reserve(count);
+
+  const auto heap_before = heap_bytes.load();
+  const auto resident_before = working_set();
+
+  // Both ends of every connection end up waiting for data
+  std::size_t idle = 0;
+  while (connections.size() < count) {
+    const auto batch = std::min(batch_size, count - connections.size());
+    for (std::size_t i = 0; i < batch; ++i) {
+      connections.push_back(std::make_unique<connection>(ioc, *server_ctx, *client_ctx, release, idle));
+      connections.back()->start();
+    }
+    while (idle < 2 * connections.size()) {
+      ioc.run_one();
+    }
+  }
+  pool->shrink();
+
+  result res;
+  res.heap_bytes = per_connection(heap_before, heap_bytes.load(), count);
+  res.resident_bytes = per_connection(resident_before, working_set(), count);
+
+  for (auto& c : connections) {
+    c->close();
+  }
+  ioc.run();
+  return res;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  options opts;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--loopback") {
+      opts.use_loopback = true;
+    } else if (arg == "--connections" && i + 1 < argc) {
+      opts.connections.push_back(std::max<std::size_t>(1, std::strtoul(argv[++i], nullptr, 10)));
+    } else {
+      std::cerr << "Unknown argument: " << arg << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+  if (opts.connections.empty()) {
+    opts.connections = {10000, 100000, 1000000};
+  }
+
+  try {
+    const benchmark::setup setup(opts.use_loopback);
+    for (auto count : opts.connections) {
+      for (const bool release : {false, true}) {
+        const auto res = run(setup, count, release);
+        std::cout << (release ? "release idle buffers: " : "keep buffers:         ") << count
+                  << " idle connections, " << res.heap_bytes << " heap bytes/connection, "
+                  << res.resident_bytes << " resident bytes/connection\n";
+      }
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
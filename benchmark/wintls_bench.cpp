@@ -0,0 +1,230 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Measures the connection setup capacity of wintls by running a
+// number of concurrent client/server handshakes over in-memory test
+// streams.
+//
+// Usage: wintls_bench [--loopback] [--count n] [--concurrency n]
+//
+// Reports handshakes per second, the p50/p99/p999 latency of a single
+// handshake, bytes allocated with operator new per handshake and the
+// process CPU time per handshake.
+//
+// With --loopback the loopback provider is installed as the SSPI
+// function table instead of Schannel. This isolates the cost of the
+// stream itself from the cost of the security package.
+
+#include "common.hpp"
+#include "test_stream/stream.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<std::size_t> bytes_allocated{0};
+
+} // namespace
+
+// Count all memory allocated with operator new. Memory allocated by
+// the security package itself is not included.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size) {
+  bytes_allocated.fetch_add(size, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+struct options {
+  bool use_loopback = false;
+  std::size_t count = 1000;
+  std::size_t concurrency = 16;
+};
+
+// Total user and kernel CPU time used by the process
+std::chrono::nanoseconds cpu_time() {
+  FILETIME creation_time;
+  FILETIME exit_time;
+  FILETIME kernel_time;
+  FILETIME user_time;
+  if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time)) {
+    return std::chrono::nanoseconds{0};
+  }
+  auto to_ticks = [](const FILETIME& time) {
+    return (static_cast<std::uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+  };
+  // FILETIME is in units of 100 nanoseconds
+  return std::chrono::nanoseconds{(to_ticks(kernel_time) + to_ticks(user_time)) * 100};
+}
+
+class runner {
+public:
+  runner(const options& opts, wintls::context& client_ctx, wintls::context& server_ctx)
+    : opts_(opts)
+    , client_ctx_(client_ctx)
+    , server_ctx_(server_ctx) {
+    latencies_.reserve(opts_.count);
+  }
+
+  void run() {
+    for (std::size_t i = 0; i < std::min(opts_.concurrency, opts_.count); ++i) {
+      start();
+    }
+    ioc_.run();
+  }
+
+  const std::vector<clock_type::duration>& latencies() const {
+    return latencies_;
+  }
+
+  std::size_t failures() const {
+    return failures_;
+  }
+
+private:
+  struct connection {
+    connection(net::io_context& ioc, wintls::context& client_ctx, wintls::context& server_ctx)
+      : client(ioc, client_ctx)
+      , server(ioc, server_ctx)
+      , start(clock_type::now()) {
+      client.next_layer().connect(server.next_layer());
+    }
+
+    wintls::stream<wintls::test::stream> client;
+    wintls::stream<wintls::test::stream> server;
+    clock_type::time_point start;
+    int pending = 2;
+    wintls::error_code ec;
+  };
+
+  void start() {
+    ++started_;
+    auto conn = std::make_shared<connection>(ioc_, client_ctx_, server_ctx_);
+    auto handler = [this, conn](const wintls::error_code& ec) {
+      if (ec && !conn->ec) {
+        conn->ec = ec;
+      }
+      if (--conn->pending == 0) {
+        completed(*conn);
+      }
+    };
+    conn->client.async_handshake(wintls::handshake_type::client, handler);
+    conn->server.async_handshake(wintls::handshake_type::server, handler);
+  }
+
+  void completed(const connection& conn) {
+    if (conn.ec) {
+      if (failures_++ == 0) {
+        std::cerr << "Handshake failed: " << conn.ec.message() << "\n";
+      }
+    } else {
+      latencies_.push_back(clock_type::now() - conn.start);
+    }
+    if (started_ < opts_.count) {
+      start();
+    }
+  }
+
+  const options& opts_;
+  wintls::context& client_ctx_;
+  wintls::context& server_ctx_;
+  net::io_context ioc_;
+  std::vector<clock_type::duration> latencies_;
+  std::size_t started_ = 0;
+  std::size_t failures_ = 0;
+};
+
+double percentile_us(const std::vector<clock_type::duration>& sorted, double percentile) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  const auto rank = static_cast<std::size_t>(std::ceil(percentile * static_cast<double>(sorted.size())));
+  const auto index = std::min(sorted.size() - 1, rank == 0 ? 0 : rank - 1);
+  return std::chrono::duration<double, std::micro>(sorted[index]).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  options opts;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--loopback") {
+      opts.use_loopback = true;
+    } else if (arg == "--count" && i + 1 < argc) {
+      opts.count = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--concurrency" && i + 1 < argc) {
+      opts.concurrency = std::max<std::size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+    } else {
+      std::cerr << "Unknown argument: " << arg << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  try {
+    const benchmark::setup setup(opts.use_loopback);
+    auto client_ctx = setup.make_client_context();
+    auto server_ctx = setup.make_server_context();
+    runner bench(opts, *client_ctx, *server_ctx);
+
+    const auto start_bytes = bytes_allocated.load();
+    const auto start_cpu = cpu_time();
+    const auto start = clock_type::now();
+    bench.run();
+    const auto elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+    const auto cpu = std::chrono::duration<double, std::micro>(cpu_time() - start_cpu).count();
+    const auto bytes = bytes_allocated.load() - start_bytes;
+
+    auto latencies = bench.latencies();
+    std::sort(latencies.begin(), latencies.end());
+    const auto handshakes = static_cast<double>(std::max<std::size_t>(1, latencies.size()));
+
+    std::cout << "provider:             " << (opts.use_loopback ? "loopback" : "schannel") << "\n"
+              << "handshakes:           " << latencies.size() << " (" << opts.concurrency << " concurrent, "
+              << bench.failures() << " failed)\n"
+              << "handshakes/s:         " << static_cast<double>(latencies.size()) / elapsed << "\n"
+              << "latency p50:          " << percentile_us(latencies, 0.50) << " us\n"
+              << "latency p99:          " << percentile_us(latencies, 0.99) << " us\n"
+              << "latency p999:         " << percentile_us(latencies, 0.999) << " us\n"
+              << "allocated/handshake:  " << static_cast<double>(bytes) / handshakes << " bytes\n"
+              << "cpu time/handshake:   " << cpu / handshakes << " us\n";
+    return bench.failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,112 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Measures the throughput of writing large buffers over a TCP
+// connection on the loopback interface with a varying number of TLS
+// records encrypted per write operation.
+//
+// Usage: write_benchmark [--loopback] [--count n] [--size bytes] [--records n]...
+//
+// Each --records option adds a run with that maximum number of
+// records per write. Defaults to comparing 1 and 8 records.
+
+#include "common.hpp"
+
+#ifdef WINTLS_USE_STANDALONE_ASIO
+#include <asio/ip/tcp.hpp>
+#include <asio/read.hpp>
+#include <asio/write.hpp>
+#else // WINTLS_USE_STANDALONE_ASIO
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#endif // !WINTLS_USE_STANDALONE_ASIO
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using tcp = net::ip::tcp;
+
+struct options {
+  bool use_loopback = false;
+  std::size_t count = 256;
+  std::size_t size = 0x100000;
+  std::vector<std::size_t> records;
+};
+
+double run(const benchmark::setup& setup, const options& opts, std::size_t records) {
+  net::io_context ioc;
+  auto server_ctx = setup.make_server_context();
+  auto client_ctx = setup.make_client_context();
+
+  tcp::acceptor acceptor(ioc, tcp::endpoint(net::ip::address_v4::loopback(), 0));
+  wintls::stream<tcp::socket> server(ioc, *server_ctx);
+  wintls::stream<tcp::socket> client(ioc, *client_ctx);
+
+  std::thread server_thread([&]() {
+    acceptor.accept(server.next_layer());
+    server.handshake(wintls::handshake_type::server);
+    std::vector<char> buffer(opts.size);
+    for (std::size_t i = 0; i < opts.count; ++i) {
+      net::read(server, net::buffer(buffer));
+    }
+  });
+
+  client.next_layer().connect(acceptor.local_endpoint());
+  client.handshake(wintls::handshake_type::client);
+  client.set_max_records_per_write(records);
+
+  const std::string data(opts.size, 'x');
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < opts.count; ++i) {
+    net::write(client, net::buffer(data));
+  }
+  server_thread.join();
+  const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  return static_cast<double>(opts.size * opts.count) / elapsed / (1024 * 1024);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  options opts;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--loopback") {
+      opts.use_loopback = true;
+    } else if (arg == "--count" && i + 1 < argc) {
+      opts.count = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--size" && i + 1 < argc) {
+      opts.size = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--records" && i + 1 < argc) {
+      opts.records.push_back(std::strtoul(argv[++i], nullptr, 10));
+    } else {
+      std::cerr << "Unknown argument: " << arg << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+  if (opts.records.empty()) {
+    opts.records = {1, 8};
+  }
+
+  try {
+    const benchmark::setup setup(opts.use_loopback);
+    for (auto records : opts.records) {
+      std::cout << records << " record(s) per write: " << opts.count << " writes of "
+                << opts.size << " bytes, " << run(setup, opts, records) << " MiB/s\n";
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
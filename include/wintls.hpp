@@ -11,11 +11,16 @@
 #include <wintls/detail/config.hpp>
 
 #include <wintls/certificate.hpp>
+#include <wintls/buffer_pool.hpp>
 #include <wintls/context.hpp>
 #include <wintls/error.hpp>
 #include <wintls/file_format.hpp>
+#include <wintls/function_table.hpp>
 #include <wintls/handshake_type.hpp>
 #include <wintls/method.hpp>
+#include <wintls/record_layout.hpp>
+#include <wintls/record_sizing.hpp>
 #include <wintls/stream.hpp>
+#include <wintls/stream_statistics.hpp>
 
 #endif // WINTLS_HPP
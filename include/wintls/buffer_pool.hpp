@@ -0,0 +1,149 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_BUFFER_POOL_HPP
+#define WINTLS_BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace wintls {
+
+/** Pool of buffers used by streams for TLS records and handshake
+ *  messages.
+ *
+ *  Streams allocate buffers for encrypted and decrypted data when
+ *  they are first needed and free them again when the stream is
+ *  destroyed. When many connections are created and destroyed, a
+ *  pool can be shared by the contexts used for creating the streams
+ *  to recycle these buffers instead of allocating them from the heap
+ *  for every connection.
+ *
+ *  Buffers are handed out in two sizes, one large enough to hold a
+ *  single TLS record and a larger one for handshake messages. Larger
+ *  allocations bypass the pool.
+ *
+ *  The pool is thread safe and may be shared by contexts used with
+ *  different execution contexts. It must not be destroyed while any
+ *  buffers allocated from it are still in use, which is ensured when
+ *  used through @ref context::use_buffer_pool.
+ */
+class buffer_pool {
+public:
+  /** Construct a buffer pool.
+   *
+   * @param max_free_buffers The maximum number of unused buffers of
+   * each size kept by the pool. Buffers returned to the pool when
+   * this limit is reached are freed.
+   */
+  explicit buffer_pool(std::size_t max_free_buffers = 1024)
+    : max_free_buffers_(max_free_buffers) {
+  }
+
+  buffer_pool(const buffer_pool&) = delete;
+  buffer_pool& operator=(const buffer_pool&) = delete;
+
+  /** Allocate a buffer.
+   *
+   * @param size The minimum size of the buffer.
+   *
+   * @returns A buffer of at least @p size bytes which must be
+   * returned with @ref deallocate using the same size.
+   */
+  char* allocate(std::size_t size) {
+    const auto index = size_class(size);
+    if (index == size_classes) {
+      return new char[size];
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto& free_list = free_lists_[index];
+      if (!free_list.empty()) {
+        auto data = free_list.back().release();
+        free_list.pop_back();
+        return data;
+      }
+    }
+    return new char[class_size(index)];
+  }
+
+  /** Return a buffer to the pool.
+   *
+   * @param data A buffer previously returned by @ref allocate.
+   * @param size The size passed to @ref allocate.
+   */
+  void deallocate(char* data, std::size_t size) {
+    std::unique_ptr<char[]> buffer{data};
+    const auto index = size_class(size);
+    if (index == size_classes) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& free_list = free_lists_[index];
+    if (free_list.size() < max_free_buffers_) {
+      free_list.push_back(std::move(buffer));
+    }
+  }
+
+  /** Get the actual size of a buffer allocated from the pool.
+   *
+   * @param size The size requested from @ref allocate.
+   *
+   * @returns The number of bytes usable in the buffer returned.
+   */
+  static std::size_t capacity(std::size_t size) {
+    const auto index = size_class(size);
+    return index == size_classes ? size : class_size(index);
+  }
+
+  /** Get the number of unused buffers kept by the pool.
+   */
+  std::size_t free_buffers() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t count = 0;
+    for (const auto& free_list : free_lists_) {
+      count += free_list.size();
+    }
+    return count;
+  }
+
+  /** Free all unused buffers kept by the pool.
+   */
+  void shrink() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& free_list : free_lists_) {
+      free_list.clear();
+    }
+  }
+
+private:
+  static constexpr std::size_t size_classes = 2;
+
+  // Record buffers fit the largest TLS record allowed including header
+  // and ciphertext expansion, handshake buffers the largest handshake
+  // message buffered by a stream.
+  static std::size_t class_size(std::size_t index) {
+    return index == 0 ? 0x5000 : 0x10000;
+  }
+
+  static std::size_t size_class(std::size_t size) {
+    for (std::size_t i = 0; i < size_classes; ++i) {
+      if (size <= class_size(i)) {
+        return i;
+      }
+    }
+    return size_classes;
+  }
+
+  mutable std::mutex mutex_;
+  std::size_t max_free_buffers_;
+  std::vector<std::unique_ptr<char[]>> free_lists_[size_classes];
+};
+
+} // namespace wintls
+
+#endif // WINTLS_BUFFER_POOL_HPP
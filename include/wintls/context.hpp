@@ -8,21 +8,35 @@
 #ifndef WINTLS_CONTEXT_HPP
 #define WINTLS_CONTEXT_HPP
 
+#include <wintls/buffer_pool.hpp>
 #include <wintls/method.hpp>
 
 #include <wintls/detail/config.hpp>
 #include <wintls/detail/context_certificates.hpp>
+#include <wintls/detail/error.hpp>
+#include <wintls/detail/sspi_credentials.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <string>
 
 namespace wintls {
 
 namespace detail {
 class sspi_handshake;
+class sspi_stream;
 }
 
 /** Holds certificates and related options required for setting up TLS
  *  connections.
+ *
+ *  The SSPI credentials used for performing handshakes are acquired
+ *  the first time they are needed and shared by all streams using
+ *  the context.
  */
 class context {
 public:
@@ -32,7 +46,8 @@ public:
    */
   explicit context(method connection_method)
     : method_(connection_method)
-    , verify_server_certificate_(false) {
+    , verify_server_certificate_(false)
+    , credentials_(std::make_shared<detail::credentials_cache>()) {
   }
 
   /** Add certification authority for performing verification.
@@ -93,6 +108,7 @@ public:
    */
   void use_default_certificates(bool use_system_certs) {
     ctx_certs_.use_default_cert_store = use_system_certs;
+    ctx_certs_.verification_results().clear();
   }
 
   /** Set the certificate to use when operating as a server
@@ -111,7 +127,9 @@ public:
    * @throws wintls::system_error Thrown on failure.
    */
   void use_certificate(const CERT_CONTEXT* cert) {
+    const auto previous = server_cert();
     ctx_certs_.use_certificate(cert);
+    credentials_->evict_certificate(previous);
   }
 
   /** Set the certificate to use when operating as a server
@@ -131,12 +149,189 @@ public:
    */
   void use_certificate(const CERT_CONTEXT* cert, wintls::error_code& ec) {
     try {
+      const auto previous = server_cert();
       ctx_certs_.use_certificate(cert);
+      credentials_->evict_certificate(previous);
     } catch (const wintls::system_error& e) {
       ec = e.code();
     }
   }
 
+  /** Use a pool for the buffers of streams created with the context
+   *
+   * Streams allocate buffers for handshake messages and encrypted
+   * and decrypted data when first needed. This function may be used
+   * to allocate these buffers from a pool which can be shared by
+   * several contexts to recycle the buffers of closed connections
+   * instead of allocating new ones from the heap.
+   *
+   * @param pool The @ref buffer_pool to allocate buffers from or a
+   * null pointer to allocate buffers from the heap.
+   *
+   * @note Only streams created after calling this function will use
+   * the pool. Each stream keeps a reference to the pool until it is
+   * destroyed.
+   */
+  void use_buffer_pool(std::shared_ptr<buffer_pool> pool) {
+    buffer_pool_ = std::move(pool);
+  }
+
+  /** Keep TLS sessions for resumption per server
+   *
+   * Schannel keeps the TLS sessions established by a client in the
+   * credentials used for the handshake and will attempt to resume a
+   * session with the same server name on the next handshake,
+   * avoiding a full handshake.
+   *
+   * By default all client streams created with the context share the
+   * same credentials. With a non zero session cache size, client
+   * credentials are instead kept per server hostname and port as set
+   * with @ref stream::set_server_hostname and @ref
+   * stream::set_server_port, so servers with the same name on
+   * different ports do not share sessions. Credentials are kept for
+   * at most max_sessions servers, evicting the least recently used
+   * ones.
+   *
+   * Whether a handshake resumed a previous session can be checked
+   * with @ref stream::session_resumed.
+   *
+   * @param max_sessions The maximum number of servers to keep
+   * sessions for. Zero shares the credentials of all servers.
+   */
+  void set_session_cache_size(std::size_t max_sessions) {
+    credentials_->set_max_sessions(max_sessions);
+  }
+
+  /** Set how long TLS sessions are kept for resumption
+   *
+   * Sets the lifetime of the sessions established by handshakes using
+   * the context in the Schannel session cache. A shorter lifetime
+   * limits how long session keys are kept in memory at the cost of
+   * more full handshakes.
+   *
+   * @param lifetime The session lifetime in milliseconds or zero to
+   * use the Schannel default of 10 hours. Lifetimes longer than
+   * Schannel supports, about 49 days, are reduced to the longest
+   * supported lifetime. Must not be negative.
+   *
+   * @note The maximum number of sessions kept by a server is a system
+   * wide Schannel setting, configured with the `MaximumCacheSize`
+   * registry value, and cannot be set per context.
+   *
+   * @throws wintls::system_error Thrown on failure.
+   */
+  void set_session_lifetime(std::chrono::milliseconds lifetime) {
+    wintls::error_code ec{};
+    set_session_lifetime(lifetime, ec);
+    if (ec) {
+      detail::throw_error(ec);
+    }
+  }
+
+  /** Set how long TLS sessions are kept for resumption
+   *
+   * Sets the lifetime of the sessions established by handshakes using
+   * the context in the Schannel session cache. A shorter lifetime
+   * limits how long session keys are kept in memory at the cost of
+   * more full handshakes.
+   *
+   * @param lifetime The session lifetime in milliseconds or zero to
+   * use the Schannel default of 10 hours. Lifetimes longer than
+   * Schannel supports, about 49 days, are reduced to the longest
+   * supported lifetime. Must not be negative.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   *
+   * @note The maximum number of sessions kept by a server is a system
+   * wide Schannel setting, configured with the `MaximumCacheSize`
+   * registry value, and cannot be set per context.
+   */
+  void set_session_lifetime(std::chrono::milliseconds lifetime, wintls::error_code& ec) {
+    if (lifetime.count() < 0) {
+      ec = error::make_error_code(SEC_E_INVALID_PARAMETER);
+      return;
+    }
+    // Schannel takes the lifespan as a 32 bit DWORD
+    constexpr auto max_lifespan = std::numeric_limits<std::uint32_t>::max();
+    session_lifespan_ = static_cast<DWORD>(std::min(lifetime.count(), static_cast<std::chrono::milliseconds::rep>(max_lifespan)));
+  }
+
+  /** Enables/disables session resumption for servers
+   *
+   * By default clients may resume previous sessions when performing
+   * handshakes with streams using the context as a server. Disabling
+   * this makes every handshake a full handshake.
+   *
+   * @param allow True if clients may resume previous sessions.
+   */
+  void allow_session_resumption(bool allow) {
+    session_resumption_ = allow;
+  }
+
+  /** Share TLS sessions with another context
+   *
+   * The Schannel session cache is kept per credentials, which are
+   * acquired by each context. This function makes the context share
+   * credentials, and thereby sessions, with another context. This
+   * allows a client to resume a session established by a server
+   * using another context, eg. when several contexts use the same
+   * certificate for the servers of a load balanced pool.
+   *
+   * Sessions are only shared when the contexts use the same @ref
+   * method, certificate and session settings.
+   *
+   * @param other The context to share sessions with.
+   *
+   * @note The setting of @ref set_session_cache_size is shared as
+   * well. Streams already created keep using the sessions of the
+   * previous credentials. The credentials acquired for the
+   * certificate of a context, and a reference to the certificate,
+   * are kept until the certificate is replaced or all contexts
+   * sharing the sessions have been destroyed.
+   */
+  void share_sessions_with(context& other) {
+    credentials_ = other.credentials_;
+  }
+
+  /** Cache the result of successful certificate verifications
+   *
+   * Verifying the certificate chain of a remote peer is expensive,
+   * especially when checking for revocation. When enabled, the
+   * context remembers which leaf certificates have been successfully
+   * verified for a given hostname and revocation setting and skips
+   * the verification when the same certificate is seen again before
+   * the entry expires. Failed verifications are never cached.
+   *
+   * The cache is disabled by default. It is cleared whenever the set
+   * of trusted certificates or revocation lists changes.
+   *
+   * @param max_entries The maximum number of verification results
+   * to keep. The least recently used entry is evicted when the cache
+   * is full. Zero disables the cache.
+   *
+   * @param ttl How long a verification result is used after the
+   * certificate was verified.
+   */
+  void set_verification_cache(std::size_t max_entries, std::chrono::seconds ttl) {
+    ctx_certs_.verification_results().configure(max_entries, ttl);
+  }
+
+  /** Number of certificate verifications skipped due to the cache
+   *
+   * @see set_verification_cache
+   */
+  std::uint64_t verification_cache_hits() const {
+    return ctx_certs_.verification_results().hits();
+  }
+
+  /** Number of certificate verifications not found in the cache
+   *
+   * @see set_verification_cache
+   */
+  std::uint64_t verification_cache_misses() const {
+    return ctx_certs_.verification_results().misses();
+  }
+
 private:
   DWORD verify_certificate(const CERT_CONTEXT* cert, const std::string& server_hostname, bool check_revocation) {
     if (!verify_server_certificate_) {
@@ -149,11 +344,23 @@ private:
     return ctx_certs_.server_cert();
   }
 
+  std::shared_ptr<detail::cred_handle> credentials(handshake_type type,
+                                                   bool check_revocation,
+                                                   const std::string& session,
+                                                   SECURITY_STATUS& sc) {
+    return credentials_->get({type, method_, server_cert(), check_revocation, session_lifespan_, session_resumption_, session}, sc);
+  }
+
   friend class detail::sspi_handshake;
+  friend class detail::sspi_stream;
 
   detail::context_certificates ctx_certs_;
   method method_;
   bool verify_server_certificate_;
+  std::shared_ptr<detail::credentials_cache> credentials_;
+  DWORD session_lifespan_ = 0;
+  bool session_resumption_ = true;
+  std::shared_ptr<buffer_pool> buffer_pool_;
 };
 
 } // namespace wintls
@@ -0,0 +1,55 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_DETAIL_ASYNC_FLUSH_HPP
+#define WINTLS_DETAIL_ASYNC_FLUSH_HPP
+
+#include <wintls/detail/bind_handler.hpp>
+#include <wintls/detail/config.hpp>
+#include <wintls/detail/coroutine.hpp>
+#include <wintls/detail/sspi_encrypt.hpp>
+
+namespace wintls {
+namespace detail {
+
+template <typename NextLayer>
+struct async_flush : net::coroutine {
+  async_flush(NextLayer& next_layer, detail::sspi_encrypt& encrypt)
+    : next_layer_(next_layer)
+    , encrypt_(encrypt) {
+  }
+
+  template <typename Self>
+  void operator()(Self& self, wintls::error_code ec = {}, std::size_t length = 0) {
+    WINTLS_ASIO_CORO_REENTER(*this) {
+      encrypt_.flush(ec);
+      if (ec || net::buffer_size(encrypt_.record()) == 0) {
+        WINTLS_ASIO_CORO_YIELD {
+          auto e = self.get_executor();
+          net::post(e, detail::bind_handler(std::move(self), ec, length));
+        }
+        self.complete(ec);
+        return;
+      }
+
+      WINTLS_ASIO_CORO_YIELD {
+        net::async_write(next_layer_, encrypt_.record(), std::move(self));
+      }
+      if (!ec) {
+        encrypt_.size_written(length);
+      }
+      self.complete(ec);
+    }
+  }
+
+private:
+  NextLayer& next_layer_;
+  detail::sspi_encrypt& encrypt_;
+};
+
+} // namespace detail
+} // namespace wintls
+
+#endif // WINTLS_DETAIL_ASYNC_FLUSH_HPP
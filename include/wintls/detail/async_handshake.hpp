@@ -10,18 +10,54 @@
 
 #include <wintls/handshake_type.hpp>
 
+#include <wintls/detail/bind_handler.hpp>
 #include <wintls/detail/config.hpp>
 #include <wintls/detail/coroutine.hpp>
 #include <wintls/detail/sspi_handshake.hpp>
 
+#include <utility>
+
 namespace wintls {
 namespace detail {
 
+// Verifies the certificate of the remote peer and continues the
+// handshake on the executor of the next layer
+template <typename NextLayer, typename Self>
+class verify_remote_certificate {
+public:
+  using allocator_type = net::associated_allocator_t<Self>;
+
+  verify_remote_certificate(NextLayer& next_layer, detail::sspi_handshake& handshake, Self&& self)
+    : next_layer_(next_layer)
+    , handshake_(handshake)
+    , self_(std::move(self)) {
+  }
+
+  allocator_type get_allocator() const noexcept {
+    return net::get_associated_allocator(self_);
+  }
+
+  void operator()() {
+    handshake_.manual_auth();
+    auto e = next_layer_.get_executor();
+    net::post(e, detail::bind_handler(std::move(self_)));
+  }
+
+private:
+  NextLayer& next_layer_;
+  detail::sspi_handshake& handshake_;
+  Self self_;
+};
+
 template <typename NextLayer>
 struct async_handshake : net::coroutine {
-  async_handshake(NextLayer& next_layer, detail::sspi_handshake& handshake, handshake_type type)
+  async_handshake(NextLayer& next_layer,
+                  detail::sspi_handshake& handshake,
+                  handshake_type type,
+                  const net::any_io_executor& verification_executor)
     : next_layer_(next_layer)
     , handshake_(handshake)
+    , verification_executor_(verification_executor)
     , entry_count_(0)
     , state_(state::idle) {
     handshake_(type);
@@ -75,7 +111,7 @@ struct async_handshake : net::coroutine {
           if (!is_continuation()) {
             WINTLS_ASIO_CORO_YIELD {
               auto e = self.get_executor();
-              net::post(e, [self = std::move(self), ec, length]() mutable { self(ec, length); });
+              net::post(e, detail::bind_handler(std::move(self), ec, length));
             }
           }
           self.complete(handshake_.last_error());
@@ -83,13 +119,25 @@ struct async_handshake : net::coroutine {
         }
       }
 
+      assert(!handshake_.last_error());
+      if (verification_executor_ && handshake_.verifies_remote_certificate()) {
+        // Verifying the certificate chain may block on fetching
+        // revocation information so do it on the verification
+        // executor and resume on the executor of the stream
+        WINTLS_ASIO_CORO_YIELD {
+          auto verification_executor = verification_executor_;
+          net::post(verification_executor, verify_remote_certificate<NextLayer, Self>{next_layer_, handshake_, std::move(self)});
+        }
+        self.complete(handshake_.last_error());
+        return;
+      }
+
       if (!is_continuation()) {
         WINTLS_ASIO_CORO_YIELD {
           auto e = self.get_executor();
-          net::post(e, [self = std::move(self), ec, length]() mutable { self(ec, length); });
+          net::post(e, detail::bind_handler(std::move(self), ec, length));
         }
       }
-      assert(!handshake_.last_error());
       handshake_.manual_auth();
       self.complete(handshake_.last_error());
     }
@@ -98,6 +146,7 @@ struct async_handshake : net::coroutine {
 private:
   NextLayer& next_layer_;
   detail::sspi_handshake& handshake_;
+  net::any_io_executor verification_executor_;
   int entry_count_;
   enum class state {
     idle,
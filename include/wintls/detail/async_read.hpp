@@ -8,10 +8,14 @@
 #ifndef WINTLS_DETAIL_ASYNC_READ_HPP
 #define WINTLS_DETAIL_ASYNC_READ_HPP
 
+#include <wintls/detail/bind_handler.hpp>
 #include <wintls/detail/config.hpp>
 #include <wintls/detail/coroutine.hpp>
 #include <wintls/detail/sspi_decrypt.hpp>
 
+#include <type_traits>
+#include <utility>
+
 namespace wintls {
 namespace detail {
 
@@ -24,9 +28,18 @@ struct async_read : net::coroutine {
     , entry_count_(0) {
   }
 
+  // Continues a read after the buffered data has already been
+  // decrypted, resulting in the given state
+  async_read(NextLayer& next_layer, const MutableBufferSequence& buffers, detail::sspi_decrypt& decrypt, detail::sspi_decrypt::state state)
+    : async_read(next_layer, buffers, decrypt) {
+    decrypted_state_ = state;
+    decrypted_ = true;
+  }
+
   template <typename Self>
   void operator()(Self& self, wintls::error_code ec = {}, std::size_t size_read = 0) {
     if (ec) {
+      decrypt_.read_failed();
       self.complete(ec, size_read);
       return;
     }
@@ -38,7 +51,7 @@ struct async_read : net::coroutine {
 
     detail::sspi_decrypt::state state;
     WINTLS_ASIO_CORO_REENTER(*this) {
-      while((state = decrypt_(buffers_)) == detail::sspi_decrypt::state::data_needed) {
+      while((state = decrypt()) == detail::sspi_decrypt::state::data_needed) {
         WINTLS_ASIO_CORO_YIELD {
           next_layer_.async_read_some(decrypt_.input_buffer, std::move(self));
         }
@@ -50,7 +63,7 @@ struct async_read : net::coroutine {
         if (!is_continuation()) {
           WINTLS_ASIO_CORO_YIELD {
             auto e = self.get_executor();
-            net::post(e, [self = std::move(self), ec, size_read]() mutable { self(ec, size_read); });
+            net::post(e, detail::bind_handler(std::move(self), ec, size_read));
           }
         }
         ec = decrypt_.last_error();
@@ -63,10 +76,65 @@ struct async_read : net::coroutine {
   }
 
 private:
+  detail::sspi_decrypt::state decrypt() {
+    if (decrypted_) {
+      decrypted_ = false;
+      return decrypted_state_;
+    }
+    return decrypt_(buffers_);
+  }
+
   NextLayer& next_layer_;
   MutableBufferSequence buffers_;
   detail::sspi_decrypt& decrypt_;
   int entry_count_;
+  detail::sspi_decrypt::state decrypted_state_ = detail::sspi_decrypt::state::data_needed;
+  bool decrypted_ = false;
+};
+
+// Starts reading unless the data can be decrypted from the data
+// already buffered, in which case the handler is posted to its
+// executor or, if immediate completion is enabled, dispatched through
+// its immediate executor without starting an asynchronous operation.
+template <typename NextLayer>
+class initiate_async_read {
+public:
+  initiate_async_read(NextLayer& next_layer, detail::sspi_decrypt& decrypt, bool immediate_completion)
+    : next_layer_(next_layer)
+    , decrypt_(decrypt)
+    , immediate_completion_(immediate_completion) {
+  }
+
+  template <typename Handler, typename MutableBufferSequence>
+  void operator()(Handler&& handler, const MutableBufferSequence& buffers) const {
+    using handler_type = typename std::decay<Handler>::type;
+    using signature = void(wintls::error_code, std::size_t);
+
+    if (!decrypt_.data_buffered()) {
+      net::async_compose<handler_type, signature>(async_read<NextLayer, MutableBufferSequence>{next_layer_, buffers, decrypt_}, handler);
+      return;
+    }
+
+    const auto state = decrypt_(buffers);
+    if (state != detail::sspi_decrypt::state::data_available) {
+      net::async_compose<handler_type, signature>(async_read<NextLayer, MutableBufferSequence>{next_layer_, buffers, decrypt_, state}, handler);
+      return;
+    }
+
+    const auto size = decrypt_.size_decrypted;
+    if (immediate_completion_) {
+      auto e = net::get_associated_immediate_executor(handler, next_layer_.get_executor());
+      net::dispatch(e, detail::bind_handler(std::forward<Handler>(handler), wintls::error_code{}, size));
+      return;
+    }
+    auto e = net::get_associated_executor(handler, next_layer_.get_executor());
+    net::post(e, detail::bind_handler(std::forward<Handler>(handler), wintls::error_code{}, size));
+  }
+
+private:
+  NextLayer& next_layer_;
+  detail::sspi_decrypt& decrypt_;
+  bool immediate_completion_;
 };
 
 } // namespace detail
@@ -8,8 +8,10 @@
 #ifndef WINTLS_DETAIL_ASYNC_SHUTDOWN_HPP
 #define WINTLS_DETAIL_ASYNC_SHUTDOWN_HPP
 
+#include <wintls/detail/bind_handler.hpp>
 #include <wintls/detail/config.hpp>
 #include <wintls/detail/coroutine.hpp>
+#include <wintls/detail/sspi_encrypt.hpp>
 #include <wintls/detail/sspi_shutdown.hpp>
 
 namespace wintls {
@@ -17,8 +19,9 @@ namespace detail {
 
 template <typename NextLayer>
 struct async_shutdown : net::coroutine {
-  async_shutdown(NextLayer& next_layer, detail::sspi_shutdown& shutdown)
+  async_shutdown(NextLayer& next_layer, detail::sspi_encrypt& encrypt, detail::sspi_shutdown& shutdown)
     : next_layer_(next_layer)
+    , encrypt_(encrypt)
     , shutdown_(shutdown)
     , entry_count_(0) {
   }
@@ -35,9 +38,19 @@ struct async_shutdown : net::coroutine {
       return entry_count_ > 1;
     };
 
-    ec = shutdown_();
-
     WINTLS_ASIO_CORO_REENTER(*this) {
+      // Data still corked is written before shutting down
+      encrypt_.flush(ec);
+      if (!ec && net::buffer_size(encrypt_.record()) > 0) {
+        WINTLS_ASIO_CORO_YIELD {
+          net::async_write(next_layer_, encrypt_.record(), std::move(self));
+        }
+        encrypt_.size_written(size_written);
+      }
+
+      if (!ec) {
+        ec = shutdown_();
+      }
       if (!ec) {
         WINTLS_ASIO_CORO_YIELD {
           net::async_write(next_layer_, shutdown_.buffer(), std::move(self));
@@ -49,7 +62,7 @@ struct async_shutdown : net::coroutine {
         if (!is_continuation()) {
           WINTLS_ASIO_CORO_YIELD {
             auto e = self.get_executor();
-            net::post(e, [self = std::move(self), ec, size_written]() mutable { self(ec, size_written); });
+            net::post(e, detail::bind_handler(std::move(self), ec, size_written));
           }
         }
         self.complete(ec);
@@ -60,6 +73,7 @@ struct async_shutdown : net::coroutine {
 
 private:
   NextLayer& next_layer_;
+  detail::sspi_encrypt& encrypt_;
   detail::sspi_shutdown& shutdown_;
   int entry_count_;
 };
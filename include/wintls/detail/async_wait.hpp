@@ -0,0 +1,63 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_DETAIL_ASYNC_WAIT_HPP
+#define WINTLS_DETAIL_ASYNC_WAIT_HPP
+
+#include <wintls/detail/bind_handler.hpp>
+#include <wintls/detail/config.hpp>
+#include <wintls/detail/sspi_decrypt.hpp>
+
+#include <utility>
+
+namespace wintls {
+namespace detail {
+
+// Waits on the next layer unless waiting for the stream to become
+// readable while a read can already be completed from the data
+// buffered, in which case the handler is posted to its executor or,
+// if immediate completion is enabled, dispatched through its
+// immediate executor.
+template <typename NextLayer>
+class initiate_async_wait {
+public:
+  initiate_async_wait(NextLayer& next_layer, detail::sspi_decrypt& decrypt, bool immediate_completion)
+    : next_layer_(next_layer)
+    , decrypt_(decrypt)
+    , immediate_completion_(immediate_completion) {
+  }
+
+  template <typename Handler>
+  void operator()(Handler&& handler, net::socket_base::wait_type type) const {
+    if (type != net::socket_base::wait_read) {
+      next_layer_.async_wait(type, std::forward<Handler>(handler));
+      return;
+    }
+
+    if (!decrypt_.data_buffered()) {
+      decrypt_.release_buffers_if_idle();
+      next_layer_.async_wait(type, std::forward<Handler>(handler));
+      return;
+    }
+
+    if (immediate_completion_) {
+      auto e = net::get_associated_immediate_executor(handler, next_layer_.get_executor());
+      net::dispatch(e, detail::bind_handler(std::forward<Handler>(handler), wintls::error_code{}));
+      return;
+    }
+    auto e = net::get_associated_executor(handler, next_layer_.get_executor());
+    net::post(e, detail::bind_handler(std::forward<Handler>(handler), wintls::error_code{}));
+  }
+
+private:
+  NextLayer& next_layer_;
+  detail::sspi_decrypt& decrypt_;
+  bool immediate_completion_;
+};
+
+} // namespace detail
+} // namespace wintls
+
+#endif // WINTLS_DETAIL_ASYNC_WAIT_HPP
@@ -8,6 +8,7 @@
 #ifndef WINTLS_DETAIL_ASYNC_WRITE_HPP
 #define WINTLS_DETAIL_ASYNC_WRITE_HPP
 
+#include <wintls/detail/bind_handler.hpp>
 #include <wintls/detail/config.hpp>
 #include <wintls/detail/coroutine.hpp>
 #include <wintls/detail/sspi_encrypt.hpp>
@@ -25,16 +26,29 @@ struct async_write : net::coroutine {
 
   template <typename Self>
   void operator()(Self& self, wintls::error_code ec = {}, std::size_t length = 0) {
-    (void)(length);
     WINTLS_ASIO_CORO_REENTER(*this) {
-      bytes_consumed_ = encrypt_(buffer_, ec);
+      bytes_consumed_ = encrypt_.write(buffer_, ec);
       if (ec) {
         self.complete(ec, 0);
         return;
       }
 
+      if (net::buffer_size(encrypt_.record()) == 0) {
+        // The data has been added to the corked record with nothing
+        // to write yet
+        WINTLS_ASIO_CORO_YIELD {
+          auto e = self.get_executor();
+          net::post(e, detail::bind_handler(std::move(self), ec, length));
+        }
+        self.complete(ec, bytes_consumed_);
+        return;
+      }
+
       WINTLS_ASIO_CORO_YIELD {
-        net::async_write(next_layer_, encrypt_.buffers, std::move(self));
+        net::async_write(next_layer_, encrypt_.record(), std::move(self));
+      }
+      if (!ec) {
+        encrypt_.size_written(length);
       }
       self.complete(ec, bytes_consumed_);
     }
@@ -0,0 +1,221 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_DETAIL_ASYNC_WRITE_QUEUED_HPP
+#define WINTLS_DETAIL_ASYNC_WRITE_QUEUED_HPP
+
+#include <wintls/detail/bind_handler.hpp>
+#include <wintls/detail/config.hpp>
+#include <wintls/detail/sspi_stream.hpp>
+#include <wintls/detail/write_queue.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace wintls {
+namespace detail {
+
+// Allocates the memory for writes to the next layer from the write
+// queue as they are not performed on behalf of any single handler
+template <typename T>
+class writer_allocator {
+public:
+  using value_type = T;
+
+  explicit writer_allocator(write_queue& queue) noexcept
+    : queue_(&queue) {
+  }
+
+  template <typename U>
+  writer_allocator(const writer_allocator<U>& other) noexcept
+    : queue_(other.queue_) {
+  }
+
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(queue_->allocate_writer(sizeof(T) * n));
+  }
+
+  void deallocate(T* pointer, std::size_t) {
+    queue_->deallocate_writer(pointer);
+  }
+
+  template <typename U>
+  bool operator==(const writer_allocator<U>& other) const noexcept {
+    return queue_ == other.queue_;
+  }
+
+  template <typename U>
+  bool operator!=(const writer_allocator<U>& other) const noexcept {
+    return queue_ != other.queue_;
+  }
+
+private:
+  template <typename U>
+  friend class writer_allocator;
+
+  write_queue* queue_;
+};
+
+// Encrypts and writes the data of queued writes in batches until the
+// queue is empty. Only a single writer is active at any time. The
+// writer shares the state of the stream to keep it alive while writing
+// to the next layer, even if the stream is destroyed in the meantime.
+template <typename NextLayer>
+class queue_writer {
+public:
+  // Maximum number of bytes and records encrypted per write to the
+  // next layer
+  static constexpr std::size_t max_batch_size = 0x40000;
+  static constexpr std::size_t max_batch_records = 16;
+
+  using allocator_type = writer_allocator<void>;
+
+  queue_writer(NextLayer& next_layer, std::shared_ptr<sspi_stream> stream)
+    : next_layer_(next_layer)
+    , stream_(std::move(stream)) {
+  }
+
+  allocator_type get_allocator() const noexcept {
+    return allocator_type{stream_->queued_writes};
+  }
+
+  void start() {
+    auto& queue = stream_->queued_writes;
+    auto& encrypt = stream_->encrypt;
+    queue.set_writing(true);
+    wintls::error_code ec{};
+    const auto size = encrypt(queue.gather(max_batch_size), ec, max_batch_records);
+    if (ec) {
+      finish(ec);
+      return;
+    }
+    queue.encrypted(size);
+    // Continue on the executor of the queued writes to stay within
+    // the strand they are performed in
+    net::async_write(next_layer_, encrypt.record(), net::bind_executor(queue.executor(), *this));
+  }
+
+  void operator()(const wintls::error_code& ec, std::size_t length) {
+    auto& queue = stream_->queued_writes;
+    if (!ec) {
+      stream_->encrypt.size_written(length);
+    }
+    queue.written(ec);
+    if (queue.closed()) {
+      // The stream and with it the next layer are gone
+      finish(net::error::operation_aborted);
+      return;
+    }
+    if (queue.empty()) {
+      queue.set_writing(false);
+      return;
+    }
+    start();
+  }
+
+private:
+  void finish(const wintls::error_code& ec) {
+    auto& queue = stream_->queued_writes;
+    queue.written(ec);
+    queue.set_writing(false);
+  }
+
+  NextLayer& next_layer_;
+  std::shared_ptr<sspi_stream> stream_;
+};
+
+// A queued write allocated using the allocator associated with its
+// handler, as is the memory for the copy of its buffers
+template <typename Self>
+class queued_write final : public write_queue::operation {
+public:
+  using allocator_type = typename std::allocator_traits<net::associated_allocator_t<Self>>::template rebind_alloc<queued_write>;
+
+  template <typename ConstBufferSequence>
+  static queued_write* create(Self&& self, const ConstBufferSequence& buffers) {
+    using traits = std::allocator_traits<allocator_type>;
+    allocator_type alloc(net::get_associated_allocator(self));
+    auto op = traits::allocate(alloc, 1);
+    try {
+      traits::construct(alloc, op, std::move(self), buffers, alloc);
+    } catch (...) {
+      traits::deallocate(alloc, op, 1);
+      throw;
+    }
+    return op;
+  }
+
+  template <typename ConstBufferSequence>
+  queued_write(Self&& self, const ConstBufferSequence& buffers, const allocator_type& alloc)
+    : self_(std::move(self))
+    , buffers_(net::buffer_sequence_begin(buffers), net::buffer_sequence_end(buffers), buffer_allocator_type(alloc))
+    , alloc_(alloc) {
+    set_buffers(buffers_.data(), buffers_.size());
+  }
+
+  net::any_io_executor executor() const override {
+    return self_.get_executor();
+  }
+
+  void complete(const wintls::error_code& ec, std::size_t size) override {
+    // Never invoke the handler from within the initiating function or
+    // outside the executor of the handler
+    auto e = self_.get_executor();
+    net::post(e, detail::bind_handler(std::move(self_), ec, size));
+  }
+
+  void destroy() override {
+    using traits = std::allocator_traits<allocator_type>;
+    auto alloc = alloc_;
+    traits::destroy(alloc, this);
+    traits::deallocate(alloc, this, 1);
+  }
+
+private:
+  using buffer_allocator_type = typename std::allocator_traits<allocator_type>::template rebind_alloc<net::const_buffer>;
+
+  Self self_;
+  std::vector<net::const_buffer, buffer_allocator_type> buffers_;
+  allocator_type alloc_;
+};
+
+template <typename NextLayer, typename ConstBufferSequence>
+struct async_write_queued {
+  async_write_queued(NextLayer& next_layer, const ConstBufferSequence& buffers, const std::shared_ptr<sspi_stream>& stream)
+    : next_layer_(next_layer)
+    , buffers_(buffers)
+    , stream_(stream) {
+  }
+
+  template <typename Self>
+  void operator()(Self& self) {
+    // This object is owned by self which is moved into the queue
+    auto& next_layer = next_layer_;
+    const auto& stream = stream_;
+    auto& queue = stream->queued_writes;
+    queue.push(queued_write<Self>::create(std::move(self), buffers_));
+    if (!queue.writing() && !queue.empty()) {
+      queue_writer<NextLayer>{next_layer, stream}.start();
+    }
+  }
+
+  // Invoked on the executor of the handler once the write is done
+  template <typename Self>
+  void operator()(Self& self, const wintls::error_code& ec, std::size_t size) {
+    self.complete(ec, size);
+  }
+
+private:
+  NextLayer& next_layer_;
+  ConstBufferSequence buffers_;
+  const std::shared_ptr<sspi_stream>& stream_;
+};
+
+} // namespace detail
+} // namespace wintls
+
+#endif // WINTLS_DETAIL_ASYNC_WRITE_QUEUED_HPP
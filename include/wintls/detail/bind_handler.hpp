@@ -0,0 +1,88 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_DETAIL_BIND_HANDLER_HPP
+#define WINTLS_DETAIL_BIND_HANDLER_HPP
+
+#include <wintls/detail/config.hpp>
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace wintls {
+namespace detail {
+
+// A handler invoked with a fixed set of arguments. Unlike a lambda or
+// std::bind it keeps the allocator associated with the handler, so
+// posting it allocates memory using that allocator.
+template <typename Handler, typename... Args>
+class bound_handler {
+public:
+  using allocator_type = net::associated_allocator_t<Handler>;
+
+  template <typename H, typename... A>
+  explicit bound_handler(H&& handler, A&&... args)
+    : handler_(std::forward<H>(handler))
+    , args_(std::forward<A>(args)...) {
+  }
+
+  allocator_type get_allocator() const noexcept {
+    return net::get_associated_allocator(handler_);
+  }
+
+  const Handler& handler() const noexcept {
+    return handler_;
+  }
+
+  void operator()() {
+    invoke(std::index_sequence_for<Args...>{});
+  }
+
+private:
+  template <std::size_t... I>
+  void invoke(std::index_sequence<I...>) {
+    handler_(std::move(std::get<I>(args_))...);
+  }
+
+  Handler handler_;
+  std::tuple<Args...> args_;
+};
+
+template <typename Handler, typename... Args>
+bound_handler<typename std::decay<Handler>::type, typename std::decay<Args>::type...> bind_handler(Handler&& handler, Args&&... args) {
+  return bound_handler<typename std::decay<Handler>::type, typename std::decay<Args>::type...>(std::forward<Handler>(handler), std::forward<Args>(args)...);
+}
+
+} // namespace detail
+} // namespace wintls
+
+#ifdef WINTLS_USE_STANDALONE_ASIO
+namespace asio {
+#else // WINTLS_USE_STANDALONE_ASIO
+namespace boost {
+namespace asio {
+#endif // !WINTLS_USE_STANDALONE_ASIO
+
+// Bound handlers are invoked on the executor associated with the
+// handler they wrap
+template <typename Executor, typename Handler, typename... Args>
+struct associated_executor<wintls::detail::bound_handler<Handler, Args...>, Executor> {
+  using type = associated_executor_t<Handler, Executor>;
+
+  static type get(const wintls::detail::bound_handler<Handler, Args...>& handler, const Executor& ex = Executor()) noexcept {
+    return get_associated_executor(handler.handler(), ex);
+  }
+};
+
+#ifdef WINTLS_USE_STANDALONE_ASIO
+} // namespace asio
+#else // WINTLS_USE_STANDALONE_ASIO
+} // namespace asio
+} // namespace boost
+#endif // !WINTLS_USE_STANDALONE_ASIO
+
+#endif // WINTLS_DETAIL_BIND_HANDLER_HPP
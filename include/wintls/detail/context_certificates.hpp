@@ -9,12 +9,14 @@
 #define WINTLS_DETAIL_CONTEXT_CERTIFICATES_HPP
 
 #include <wintls/detail/config.hpp>
+#include <wintls/detail/verification_cache.hpp>
 
 #include <wintls/certificate.hpp>
 #include <wintls/error.hpp>
 
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <type_traits>
 
@@ -29,10 +31,21 @@ struct cert_store_deleter {
 
 using cert_store_ptr = std::unique_ptr<std::remove_pointer_t<HCERTSTORE>, cert_store_deleter>;
 
+struct cert_chain_engine_deleter {
+  void operator()(HCERTCHAINENGINE engine) {
+    CertFreeCertificateChainEngine(engine);
+  }
+};
+
+using cert_chain_engine_ptr = std::shared_ptr<std::remove_pointer_t<HCERTCHAINENGINE>>;
+
 class context_certificates {
 public:
   void add_certificate_authority(const CERT_CONTEXT* cert) {
+    std::lock_guard<std::mutex> lock(*mutex_);
     init_cert_store();
+    chain_engine_.reset();
+    verification_cache_->clear();
     if(!CertAddCertificateContextToStore(cert_store_.get(),
                                          cert,
                                          CERT_STORE_ADD_ALWAYS,
@@ -42,7 +55,10 @@ public:
   }
 
   void add_crl(const CRL_CONTEXT* crl_ctx) {
+    std::lock_guard<std::mutex> lock(*mutex_);
     init_cert_store();
+    chain_engine_.reset();
+    verification_cache_->clear();
     if (!CertAddCRLContextToStore(cert_store_.get(),
                                   crl_ctx,
                                   CERT_STORE_ADD_ALWAYS,
@@ -52,33 +68,18 @@ public:
   }
 
   HRESULT verify_certificate(const CERT_CONTEXT* cert, const std::string& server_hostname, bool check_revocation) {
-    HRESULT status = CERT_E_UNTRUSTEDROOT;
-
-    if (cert_store_) {
-      CERT_CHAIN_ENGINE_CONFIG chain_engine_config{};
-      chain_engine_config.cbSize = sizeof(chain_engine_config);
-      chain_engine_config.hExclusiveRoot = cert_store_.get();
-
-      struct cert_chain_engine {
-        ~cert_chain_engine() {
-          CertFreeCertificateChainEngine(ptr);
-        }
-        HCERTCHAINENGINE ptr = nullptr;
-      } chain_engine;
-
-      if (!CertCreateCertificateChainEngine(&chain_engine_config, &chain_engine.ptr)) {
-        return static_cast<HRESULT>(GetLastError());
+    std::string cache_key;
+    if (verification_cache_->enabled()) {
+      cache_key = verification_cache_key(cert, server_hostname, check_revocation);
+      if (!cache_key.empty() && verification_cache_->find(cache_key, verification_cache::clock::now())) {
+        return ERROR_SUCCESS;
       }
-
-      status = static_cast<HRESULT>(verify_certificate_chain(cert, chain_engine.ptr, server_hostname, check_revocation));
     }
 
-    if (status != ERROR_SUCCESS && use_default_cert_store) {
-      // Calling CertGetCertificateChain with a NULL pointer engine uses
-      // the default system certificate store
-      status = static_cast<HRESULT>(verify_certificate_chain(cert, nullptr, server_hostname, check_revocation));
+    const auto status = verify_certificate_chains(cert, server_hostname, check_revocation);
+    if (status == ERROR_SUCCESS && !cache_key.empty()) {
+      verification_cache_->insert(cache_key, verification_cache::clock::now());
     }
-
     return status;
   }
 
@@ -101,9 +102,64 @@ public:
     return server_cert_.get();
   }
 
+  verification_cache& verification_results() {
+    return *verification_cache_;
+  }
+
+  const verification_cache& verification_results() const {
+    return *verification_cache_;
+  }
+
   bool use_default_cert_store = false;
 
 private:
+  HRESULT verify_certificate_chains(const CERT_CONTEXT* cert, const std::string& server_hostname, bool check_revocation) {
+    HRESULT status = CERT_E_UNTRUSTEDROOT;
+
+    cert_chain_engine_ptr chain_engine;
+    {
+      std::lock_guard<std::mutex> lock(*mutex_);
+      if (cert_store_ && !chain_engine_) {
+        CERT_CHAIN_ENGINE_CONFIG chain_engine_config{};
+        chain_engine_config.cbSize = sizeof(chain_engine_config);
+        chain_engine_config.hExclusiveRoot = cert_store_.get();
+
+        HCERTCHAINENGINE engine = nullptr;
+        if (!CertCreateCertificateChainEngine(&chain_engine_config, &engine)) {
+          return static_cast<HRESULT>(GetLastError());
+        }
+        chain_engine_ = cert_chain_engine_ptr{engine, cert_chain_engine_deleter{}};
+      }
+      chain_engine = chain_engine_;
+    }
+
+    if (chain_engine) {
+      status = static_cast<HRESULT>(verify_certificate_chain(cert, chain_engine.get(), server_hostname, check_revocation));
+    }
+
+    if (status != ERROR_SUCCESS && use_default_cert_store) {
+      // Calling CertGetCertificateChain with a NULL pointer engine uses
+      // the default system certificate store
+      status = static_cast<HRESULT>(verify_certificate_chain(cert, nullptr, server_hostname, check_revocation));
+    }
+
+    return status;
+  }
+
+  // The SHA-256 hash of the certificate combined with the parameters
+  // of the verification or an empty string if hashing fails
+  static std::string verification_cache_key(const CERT_CONTEXT* cert, const std::string& server_hostname, bool check_revocation) {
+    BYTE hash[32];
+    DWORD hash_size = sizeof(hash);
+    if (!CryptHashCertificate2(L"SHA256", 0, nullptr, cert->pbCertEncoded, cert->cbCertEncoded, hash, &hash_size)) {
+      return {};
+    }
+    std::string key(reinterpret_cast<const char*>(hash), hash_size);
+    key += check_revocation ? '1' : '0';
+    key += server_hostname;
+    return key;
+  }
+
   void init_cert_store() {
     if (!cert_store_) {
       cert_store_ = cert_store_ptr{CertOpenStore(CERT_STORE_PROV_MEMORY, 0, 0, 0, nullptr)};
@@ -170,6 +226,13 @@ private:
 
   cert_store_ptr cert_store_{};
   cert_context_ptr server_cert_{};
+
+  // The chain engine caches the chains and revocation information it
+  // has built, so it is kept until the trusted certificates change.
+  // Verifications already in progress keep using the previous engine.
+  std::unique_ptr<std::mutex> mutex_ = std::make_unique<std::mutex>();
+  cert_chain_engine_ptr chain_engine_{};
+  std::unique_ptr<verification_cache> verification_cache_ = std::make_unique<verification_cache>();
 };
 
 } // namespace detail
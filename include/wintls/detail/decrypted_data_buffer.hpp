@@ -9,17 +9,24 @@
 #define WINTLS_DETAIL_DECRYPTED_DATA_BUFFER_HPP
 
 #include <wintls/detail/config.hpp>
+#include <wintls/detail/stream_buffer.hpp>
 
-#include <array>
 #include <cassert>
 #include <cstddef>
+#include <memory>
 
 namespace wintls {
 namespace detail {
 
-template <std::size_t BufferSize>
+// Holds decrypted data which did not fit in the buffers supplied by
+// the user. Storage is allocated on first use and grown to fit the
+// largest record seen, which is bounded by the maximum TLS record size.
 class decrypted_data_buffer {
 public:
+  explicit decrypted_data_buffer(std::shared_ptr<buffer_pool> pool = nullptr)
+    : buffer_(std::move(pool)) {
+  }
+
   std::size_t empty() const {
     return available_data_.size() == 0;
   }
@@ -34,13 +41,22 @@ public:
   template <class ConstBufferSequence>
   void fill(const ConstBufferSequence& buffer) {
     assert(available_data_.size() == 0);
-    const auto size = net::buffer_copy(net::buffer(buffer_), buffer);
+    if (buffer_.size() < net::buffer_size(buffer)) {
+      buffer_.resize(net::buffer_size(buffer));
+    }
+    const auto size = net::buffer_copy(buffer_.asio_buffer(), buffer);
     available_data_ = net::buffer(buffer_.data(), size);
   }
 
+  // Frees the storage, which must not hold any data
+  void release() {
+    assert(available_data_.size() == 0);
+    buffer_.release();
+  }
+
 private:
   net::mutable_buffer available_data_;
-  std::array<char, BufferSize> buffer_;
+  stream_buffer buffer_;
 };
 
 } // namespace detail
@@ -8,52 +8,183 @@
 #ifndef WINTLS_DETAIL_ENCRYPT_BUFFERS_HPP
 #define WINTLS_DETAIL_ENCRYPT_BUFFERS_HPP
 
+#include <wintls/record_layout.hpp>
+
 #include <wintls/detail/sspi_buffer_sequence.hpp>
 #include <wintls/detail/sspi_functions.hpp>
 #include <wintls/detail/config.hpp>
+#include <wintls/detail/stream_buffer.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <utility>
 
 namespace wintls {
 namespace detail {
 
+// Position in a buffer sequence being encrypted, so the data of each
+// record is copied from where the previous record ended instead of
+// walking the sequence from the start. Empty buffers are skipped.
+template <typename ConstBufferSequence>
+class buffer_sequence_cursor {
+public:
+  explicit buffer_sequence_cursor(const ConstBufferSequence& buffers)
+    : it_(net::buffer_sequence_begin(buffers))
+    , end_(net::buffer_sequence_end(buffers)) {
+  }
+
+  std::size_t copy(net::mutable_buffer target) {
+    std::size_t size_copied = 0;
+    while (it_ != end_ && target.size() > 0) {
+      const net::const_buffer buffer(*it_);
+      const auto size = net::buffer_copy(target, buffer + offset_);
+      target += size;
+      size_copied += size;
+      offset_ += size;
+      if (offset_ == buffer.size()) {
+        ++it_;
+        offset_ = 0;
+      }
+    }
+    return size_copied;
+  }
+
+private:
+  using iterator = decltype(net::buffer_sequence_begin(std::declval<const ConstBufferSequence&>()));
+
+  iterator it_;
+  iterator end_;
+  std::size_t offset_ = 0;
+};
+
 class encrypt_buffers : public sspi_buffer_sequence<4> {
 public:
-  encrypt_buffers(ctxt_handle& ctxt_handle)
+  encrypt_buffers(ctxt_handle& ctxt_handle, const std::shared_ptr<buffer_pool>& pool)
     : sspi_buffer_sequence(std::array<sspi_buffer, 4> {
         SECBUFFER_STREAM_HEADER,
         SECBUFFER_DATA,
         SECBUFFER_STREAM_TRAILER,
         SECBUFFER_EMPTY
       })
-    , ctxt_handle_(ctxt_handle) {
+    , ctxt_handle_(ctxt_handle)
+    , data_(pool) {
   }
 
-  template <typename ConstBufferSequence> std::size_t operator()(const ConstBufferSequence& buffers, SECURITY_STATUS& sc) {
-    if (data_.empty()) {
-      sc = sspi_functions::QueryContextAttributesA(ctxt_handle_.get(), SECPKG_ATTR_STREAM_SIZES, &stream_sizes_);
-      if (sc != SEC_E_OK) {
-        return 0;
-      }
-      data_.resize(stream_sizes_.cbHeader + stream_sizes_.cbMaximumMessage + stream_sizes_.cbTrailer);
+  // Prepares the buffers for encrypting up to max_records records,
+  // discarding any previously encrypted records. The size of the
+  // data of the first record is used for estimating the number of
+  // records needed.
+  void reset(std::size_t max_records, std::size_t size, std::size_t record_size, SECURITY_STATUS& sc) {
+    size_ = 0;
+    records_ = 0;
+    if (!query_stream_sizes(sc)) {
+      return;
+    }
+    const std::size_t max_message = stream_sizes_.cbMaximumMessage;
+    record_size = std::max<std::size_t>(1, std::min<std::size_t>(record_size, max_message));
+    max_records_ = std::max<std::size_t>(1, std::min(max_records, (size + record_size - 1) / record_size));
+    const auto capacity = max_records_ * (stream_sizes_.cbHeader + max_message + stream_sizes_.cbTrailer);
+    if (data_.size() < capacity) {
+      data_.resize(capacity);
     }
+  }
 
-    const auto size_consumed = std::min(net::buffer_size(buffers), static_cast<size_t>(stream_sizes_.cbMaximumMessage));
+  // Frees the memory holding the encrypted records
+  void release() {
+    data_.release();
+  }
+
+  // Copies up to record_size bytes of data for the next record from
+  // the input, directly after any records already encrypted.
+  template <typename ConstBufferSequence>
+  std::size_t operator()(buffer_sequence_cursor<ConstBufferSequence>& input, std::size_t record_size) {
+    auto record = data_.data() + size_;
+    const auto max_size = std::min<std::size_t>(record_size, stream_sizes_.cbMaximumMessage);
+    const auto size_consumed = input.copy(net::buffer(record + stream_sizes_.cbHeader, max_size));
 
-    buffers_[0].pvBuffer = data_.data();
+    buffers_[0].pvBuffer = record;
     buffers_[0].cbBuffer = stream_sizes_.cbHeader;
 
-    net::buffer_copy(net::buffer(data_.data() + stream_sizes_.cbHeader, size_consumed), buffers);
-    buffers_[1].pvBuffer = data_.data() + stream_sizes_.cbHeader;
+    buffers_[1].pvBuffer = record + stream_sizes_.cbHeader;
     buffers_[1].cbBuffer = static_cast<ULONG>(size_consumed);
 
-    buffers_[2].pvBuffer = data_.data() + stream_sizes_.cbHeader + size_consumed;
+    buffers_[2].pvBuffer = record + stream_sizes_.cbHeader + size_consumed;
     buffers_[2].cbBuffer = stream_sizes_.cbTrailer;
 
     return size_consumed;
   }
 
+  // Appends the record just encrypted to the encrypted data. Records
+  // are contiguous as the header, data and trailer of each record
+  // are.
+  void commit() {
+    size_ += buffers_[0].cbBuffer + buffers_[1].cbBuffer + buffers_[2].cbBuffer;
+    ++records_;
+  }
+
+  bool full() const {
+    return records_ == max_records_;
+  }
+
+  // Points the buffers at a single record laid out by the caller with
+  // room for the header and trailer around the data, encrypting the
+  // data in place instead of copying it.
+  void in_place(net::mutable_buffer buffer, std::size_t size, SECURITY_STATUS& sc) {
+    size_ = 0;
+    records_ = 0;
+    if (!query_stream_sizes(sc)) {
+      return;
+    }
+    if (size > stream_sizes_.cbMaximumMessage ||
+        buffer.size() < stream_sizes_.cbHeader + size + stream_sizes_.cbTrailer) {
+      sc = SEC_E_INVALID_PARAMETER;
+      return;
+    }
+    auto record = static_cast<char*>(buffer.data());
+
+    buffers_[0].pvBuffer = record;
+    buffers_[0].cbBuffer = stream_sizes_.cbHeader;
+
+    buffers_[1].pvBuffer = record + stream_sizes_.cbHeader;
+    buffers_[1].cbBuffer = static_cast<ULONG>(size);
+
+    buffers_[2].pvBuffer = record + stream_sizes_.cbHeader + size;
+    buffers_[2].cbBuffer = stream_sizes_.cbTrailer;
+  }
+
+  // The record encrypted in place. Only valid after encrypting a
+  // record prepared by in_place.
+  net::const_buffer in_place_record() const {
+    return net::buffer(buffers_[0].pvBuffer, buffers_[0].cbBuffer + buffers_[1].cbBuffer + buffers_[2].cbBuffer);
+  }
+
+  record_layout layout(SECURITY_STATUS& sc) {
+    if (!query_stream_sizes(sc)) {
+      return {};
+    }
+    return {stream_sizes_.cbHeader, stream_sizes_.cbMaximumMessage, stream_sizes_.cbTrailer};
+  }
+
+  // The encrypted records as a single buffer
+  net::const_buffer record() const {
+    return net::buffer(data_.data(), size_);
+  }
+
 private:
+  bool query_stream_sizes(SECURITY_STATUS& sc) {
+    if (stream_sizes_.cbMaximumMessage == 0) {
+      sc = sspi_functions::QueryContextAttributesA(ctxt_handle_.get(), SECPKG_ATTR_STREAM_SIZES, &stream_sizes_);
+    }
+    return sc == SEC_E_OK;
+  }
+
   ctxt_handle& ctxt_handle_;
-  std::vector<char> data_;
+  stream_buffer data_;
+  std::size_t size_ = 0;
+  std::size_t records_ = 0;
+  std::size_t max_records_ = 0;
   SecPkgContext_StreamSizes stream_sizes_{0, 0, 0, 0, 0};
 };
 
@@ -0,0 +1,80 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_DETAIL_RECORD_SIZER_HPP
+#define WINTLS_DETAIL_RECORD_SIZER_HPP
+
+#include <wintls/record_sizing.hpp>
+
+#include <wintls/detail/statistics.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+namespace wintls {
+namespace detail {
+
+// Decides the size of the records written according to a
+// record_sizing policy. Disabled until a policy is set.
+class record_sizer {
+public:
+  explicit record_sizer(statistics& stats)
+    : stats_(stats) {
+    sizing_.ramp_up_size = 0;
+  }
+
+  void set(const record_sizing& sizing) {
+    sizing_ = sizing;
+    sizing_.small_record_size = std::max<std::size_t>(sizing_.small_record_size, 1);
+    size_written_ = 0;
+    last_write_ = {};
+  }
+
+  // Starts using small records again if the stream has been idle
+  // since the last write
+  void start_write() {
+    if (sizing_.ramp_up_size == 0) {
+      return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (sizing_.idle_timeout.count() > 0 && last_write_ != std::chrono::steady_clock::time_point{} &&
+        now - last_write_ >= sizing_.idle_timeout && size_written_ >= sizing_.ramp_up_size) {
+      size_written_ = 0;
+      stats_.record_sizing_reset();
+    }
+    last_write_ = now;
+  }
+
+  // The maximum size of the data of the next record
+  std::size_t record_size(std::size_t max_size) const {
+    if (small()) {
+      return std::min(sizing_.small_record_size, max_size);
+    }
+    return max_size;
+  }
+
+  void record_encrypted(std::size_t size) {
+    if (small()) {
+      stats_.small_record_encrypted();
+      size_written_ += size;
+    }
+  }
+
+private:
+  bool small() const {
+    return size_written_ < sizing_.ramp_up_size;
+  }
+
+  statistics& stats_;
+  record_sizing sizing_;
+  std::size_t size_written_ = 0;
+  std::chrono::steady_clock::time_point last_write_;
+};
+
+} // namespace detail
+} // namespace wintls
+
+#endif // WINTLS_DETAIL_RECORD_SIZER_HPP
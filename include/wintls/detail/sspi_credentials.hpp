@@ -0,0 +1,218 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_DETAIL_SSPI_CREDENTIALS_HPP
+#define WINTLS_DETAIL_SSPI_CREDENTIALS_HPP
+
+#include <wintls/certificate.hpp>
+#include <wintls/handshake_type.hpp>
+#include <wintls/method.hpp>
+
+#include <wintls/detail/config.hpp>
+#include <wintls/detail/sspi_functions.hpp>
+#include <wintls/detail/sspi_sec_handle.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace wintls {
+namespace detail {
+
+struct credentials_key {
+  handshake_type type;
+  method connection_method;
+  const CERT_CONTEXT* cert;
+  bool check_revocation;
+  DWORD session_lifespan;
+  bool session_resumption;
+  // Server the TLS sessions of the credentials are resumed with or
+  // empty if shared by all servers
+  std::string session;
+
+  bool operator==(const credentials_key& other) const {
+    return type == other.type &&
+      connection_method == other.connection_method &&
+      cert == other.cert &&
+      check_revocation == other.check_revocation &&
+      session_lifespan == other.session_lifespan &&
+      session_resumption == other.session_resumption &&
+      session == other.session;
+  }
+};
+
+inline SECURITY_STATUS acquire_credentials(const credentials_key& key, cred_handle& handle) {
+  TLS_PARAMETERS tls_parameters{};
+  SCH_CREDENTIALS credentials{};
+  SCHANNEL_CRED creds{};
+  void* cred = nullptr;
+
+  auto usage = [&key]() {
+    switch (key.type) {
+      case handshake_type::client:
+        return SECPKG_CRED_OUTBOUND;
+      case handshake_type::server:
+        return SECPKG_CRED_INBOUND;
+    }
+    WINTLS_UNREACHABLE_RETURN(0);
+  }();
+
+  bool is_tlsv13 = [&key]() {
+    switch (key.connection_method) {
+      case method::tlsv13:
+      case method::tlsv13_client:
+      case method::tlsv13_server:
+        return true;
+      default:
+        return false;
+    }
+    WINTLS_UNREACHABLE_RETURN(0);
+  }();
+
+  DWORD version = is_tlsv13 ? SCH_CREDENTIALS_VERSION : SCHANNEL_CRED_VERSION;
+  DWORD flags = is_tlsv13 ? SCH_USE_STRONG_CRYPTO : (SCH_CRED_MANUAL_CRED_VALIDATION | SCH_CRED_NO_DEFAULT_CREDS);
+  DWORD protocols = static_cast<DWORD>(key.connection_method);
+
+  // If revocation checking is enables, specify SCH_CRED_REVOCATION_CHECK_CHAIN_EXCLUDE_ROOT
+  // to cause the TLS certificate status request extension (commonly known as OCSP stapling)
+  // to be sent. This flag matches the CERT_CHAIN_REVOCATION_CHECK_CHAIN_EXCLUDE_ROOT
+  // flag that we pass to the CertGetCertificateChain calls during our manual authentication.
+  if (key.check_revocation) {
+    flags |= SCH_CRED_REVOCATION_CHECK_CHAIN_EXCLUDE_ROOT;
+  }
+
+  if (!key.session_resumption && key.type == handshake_type::server) {
+    flags |= SCH_CRED_DISABLE_RECONNECTS;
+  }
+
+  // Note: if client cert is set, sspi will auto validate server cert with it.
+  // Even though verify_server_certificate_ in context is set to false.
+  auto cert = key.cert;
+  DWORD num_creds = cert != nullptr ? 1 : 0;
+  decltype(&cert) creds_list = cert != nullptr ? &cert : nullptr;
+
+  if (!is_tlsv13) {
+    cred = &creds;
+    creds.dwVersion = version;
+    creds.grbitEnabledProtocols = protocols;
+    creds.dwFlags = flags;
+    creds.dwSessionLifespan = key.session_lifespan;
+    creds.cCreds = num_creds;
+    creds.paCred = creds_list;
+  } else {
+    cred = &credentials;
+    credentials.dwVersion = version;
+    credentials.dwFlags = flags;
+    credentials.dwSessionLifespan = key.session_lifespan;
+    credentials.cTlsParameters = 1;
+    credentials.pTlsParameters = &tls_parameters;
+    credentials.pTlsParameters->grbitDisabledProtocols = ~protocols;
+    credentials.cCreds = num_creds;
+    credentials.paCred = creds_list;
+  }
+
+  TimeStamp expiry;
+  return detail::sspi_functions::AcquireCredentialsHandleA(nullptr,
+                                                          const_cast<SEC_CHAR*>(UNISP_NAME),
+                                                          static_cast<unsigned>(usage),
+                                                          nullptr,
+                                                          cred,
+                                                          nullptr,
+                                                          nullptr,
+                                                          handle.get(),
+                                                          &expiry);
+}
+
+// Credential handles acquired on behalf of a context. Each handle is
+// shared by all streams created from the context with the same
+// credentials key and is freed when the last user releases it.
+//
+// Entries hold a reference to the certificate of their key. The
+// certificate can then not be freed and its address reused by the
+// certificate of another context sharing the cache while the entry
+// is kept, which would otherwise be given the wrong credentials.
+//
+// Schannel keeps its session cache in the credential handle, so
+// credentials are acquired per server when max_sessions is non zero,
+// keeping them for at most max_sessions servers and evicting the
+// least recently used ones.
+class credentials_cache {
+public:
+  std::shared_ptr<cred_handle> get(credentials_key key, SECURITY_STATUS& sc) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (max_sessions_ == 0) {
+      key.session.clear();
+    }
+    auto it = std::find_if(entries_.begin(), entries_.end(), [&key](const entry& cached) {
+      return cached.key == key;
+    });
+    if (it != entries_.end()) {
+      // Keep the most recently used entries last
+      std::rotate(it, it + 1, entries_.end());
+      sc = SEC_E_OK;
+      return entries_.back().handle;
+    }
+
+    auto handle = std::make_shared<cred_handle>();
+    sc = acquire_credentials(key, *handle);
+    if (sc != SEC_E_OK) {
+      return nullptr;
+    }
+    if (!key.session.empty()) {
+      evict_sessions(max_sessions_ - 1);
+    }
+    cert_context_ptr cert{key.cert != nullptr ? CertDuplicateCertificateContext(key.cert) : nullptr};
+    entries_.push_back({std::move(key), std::move(cert), handle});
+    return handle;
+  }
+
+  void set_max_sessions(std::size_t max_sessions) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_sessions_ = max_sessions;
+    evict_sessions(max_sessions_);
+  }
+
+  // Removes the credentials acquired with a certificate no longer
+  // used, keeping those of other contexts sharing the cache
+  void evict_certificate(const CERT_CONTEXT* cert) {
+    if (cert == nullptr) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(std::remove_if(entries_.begin(), entries_.end(), [cert](const entry& cached) {
+      return cached.key.cert == cert;
+    }), entries_.end());
+  }
+
+private:
+  struct entry {
+    credentials_key key;
+    cert_context_ptr cert;
+    std::shared_ptr<cred_handle> handle;
+  };
+
+  // Removes the least recently used per server credentials until at
+  // most max_sessions are left
+  void evict_sessions(std::size_t max_sessions) {
+    auto is_session = [](const entry& cached) {
+      return !cached.key.session.empty();
+    };
+    auto sessions = static_cast<std::size_t>(std::count_if(entries_.begin(), entries_.end(), is_session));
+    for (; sessions > max_sessions; --sessions) {
+      entries_.erase(std::find_if(entries_.begin(), entries_.end(), is_session));
+    }
+  }
+
+  std::mutex mutex_;
+  std::vector<entry> entries_;
+  std::size_t max_sessions_ = 0;
+};
+
+} // namespace detail
+} // namespace wintls
+
+#endif // WINTLS_DETAIL_SSPI_CREDENTIALS_HPP
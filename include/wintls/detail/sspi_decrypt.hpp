@@ -8,14 +8,19 @@
 #ifndef WINTLS_DETAIL_SSPI_DECRYPT_HPP
 #define WINTLS_DETAIL_SSPI_DECRYPT_HPP
 
+#include <wintls/detail/assert.hpp>
 #include <wintls/detail/config.hpp>
 #include <wintls/detail/sspi_functions.hpp>
 #include <wintls/detail/decrypt_buffers.hpp>
 #include <wintls/detail/decrypted_data_buffer.hpp>
 #include <wintls/detail/sspi_sec_handle.hpp>
+#include <wintls/detail/statistics.hpp>
+#include <wintls/detail/stream_buffer.hpp>
 
 #include <array>
 #include <cstdint>
+#include <cstring>
+#include <memory>
 
 namespace wintls {
 namespace detail {
@@ -29,19 +34,29 @@ public:
     error
   };
 
-  sspi_decrypt(ctxt_handle& ctxt_handle)
+  sspi_decrypt(ctxt_handle& ctxt_handle, const std::shared_ptr<buffer_pool>& pool, statistics& stats)
     : size_decrypted(0)
-    , input_buffer(net::buffer(encrypted_data_))
     , ctxt_handle_(ctxt_handle)
-    , last_error_(SEC_E_OK) {
-    buffers_[0].pvBuffer = encrypted_data_.data();
+    , stats_(stats)
+    , last_error_(SEC_E_OK)
+    , encrypted_data_(pool)
+    , decrypted_data_(pool) {
   }
 
   void load_renegotiate_extra_data(wintls::detail::sspi_buffer& extra_buffer) {
+    output_buffer_ = net::mutable_buffer{};
+    offset_ = 0;
+    probing_ = false;
+    if (query_record_size()) {
+      allocate_encrypted_data();
+    }
+    if (encrypted_data_.size() < extra_buffer.cbBuffer) {
+      encrypted_data_.resize(extra_buffer.cbBuffer);
+    }
     buffers_[0].cbBuffer = extra_buffer.cbBuffer;
     buffers_[0].pvBuffer = encrypted_data_.data();
     std::memmove(encrypted_data_.data(), extra_buffer.pvBuffer, extra_buffer.cbBuffer);
-    input_buffer = net::buffer(encrypted_data_) + buffers_[0].cbBuffer;
+    input_buffer = encrypted_data_.asio_buffer() + buffers_[0].cbBuffer;
   }
 
   wintls::detail::sspi_buffer& get_renegotiate_data_buffer() {
@@ -52,60 +67,183 @@ public:
   state operator()(const MutableBufferSequence& output_buffers) {
     if (!decrypted_data_.empty()) {
       size_decrypted = decrypted_data_.get(output_buffers);
+      stats_.plaintext_copied(size_decrypted);
+      stats_.plaintext_read(size_decrypted);
       return state::data_available;
     }
 
+    if (pending_status_ != SEC_E_OK) {
+      // Report the status of a record following records already
+      // returned to the caller.
+      last_error_ = pending_status_;
+      pending_status_ = SEC_E_OK;
+      return last_error_ == SEC_I_RENEGOTIATE ? state::renegotiate_handshake : state::error;
+    }
+
+    if (!query_record_size()) {
+      return state::error;
+    }
+
     if (buffers_[0].cbBuffer == 0) {
-      input_buffer = net::buffer(encrypted_data_);
-      return state::data_needed;
+      return start_read(output_buffers);
     }
 
-    buffers_[0].BufferType = SECBUFFER_DATA;
-    buffers_[1].BufferType = SECBUFFER_EMPTY;
-    buffers_[2].BufferType = SECBUFFER_EMPTY;
-    buffers_[3].BufferType = SECBUFFER_EMPTY;
+    // Decrypt all complete records available, filling as much of the
+    // output buffers as possible. The records are consumed by
+    // advancing an offset into the input data, so the remaining data
+    // is only moved once more data is needed.
+    size_decrypted = 0;
+    const std::size_t output_size = net::buffer_size(output_buffers);
+    do {
+      buffers_[0].BufferType = SECBUFFER_DATA;
+      buffers_[0].pvBuffer = (input_data() + offset_).data();
+      buffers_[1].BufferType = SECBUFFER_EMPTY;
+      buffers_[2].BufferType = SECBUFFER_EMPTY;
+      buffers_[3].BufferType = SECBUFFER_EMPTY;
 
-    input_buffer = net::buffer(encrypted_data_) + buffers_[0].cbBuffer;
-    const auto size = buffers_[0].cbBuffer;
-    last_error_ = detail::sspi_functions::DecryptMessage(ctxt_handle_.get(), buffers_.desc(), 0, nullptr);
+      const auto size = buffers_[0].cbBuffer;
+      last_error_ = detail::sspi_functions::DecryptMessage(ctxt_handle_.get(), buffers_.desc(), 0, nullptr);
 
-    if (last_error_ == SEC_E_INCOMPLETE_MESSAGE) {
-      buffers_[0].cbBuffer = size;
-      return state::data_needed;
-    }
+      if (last_error_ == SEC_E_INCOMPLETE_MESSAGE) {
+        buffers_[0].cbBuffer = size;
+        buffers_[0].pvBuffer = (input_data() + offset_).data();
+        if (size_decrypted > 0) {
+          break;
+        }
+        stats_.incomplete_record();
+        prepare_read();
+        return state::data_needed;
+      }
 
-    if (last_error_ != SEC_E_OK && last_error_ != SEC_I_RENEGOTIATE) {
-      return state::error;
-    }
+      if (last_error_ != SEC_E_OK && last_error_ != SEC_I_RENEGOTIATE) {
+        buffers_[0].cbBuffer = size;
+        buffers_[0].pvBuffer = (input_data() + offset_).data();
+        move_to_encrypted_data();
+        if (size_decrypted > 0) {
+          pending_status_ = last_error_;
+          stats_.plaintext_read(size_decrypted);
+          return state::data_available;
+        }
+        return state::error;
+      }
 
-    if (buffers_[1].BufferType == SECBUFFER_DATA) {
-      const auto data_ptr = reinterpret_cast<const char*>(buffers_[1].pvBuffer);
-      const auto data_size = buffers_[1].cbBuffer;
-      size_decrypted = net::buffer_copy(output_buffers, net::buffer(data_ptr, data_size));
-      if (size_decrypted < data_size) {
-        decrypted_data_.fill(net::buffer(data_ptr + size_decrypted, data_size - size_decrypted));
+      stats_.record_decrypted();
+      if (buffers_[1].BufferType == SECBUFFER_DATA) {
+        const auto data_ptr = reinterpret_cast<const char*>(buffers_[1].pvBuffer);
+        const auto data_size = buffers_[1].cbBuffer;
+        if (output_buffer_.size() > 0) {
+          // The plaintext of a record is always smaller than the
+          // record itself, so it never overlaps any data not yet
+          // decrypted.
+          std::memmove((output_buffer_ + size_decrypted).data(), data_ptr, data_size);
+          stats_.plaintext_copied(data_size);
+          size_decrypted += data_size;
+        } else {
+          const auto size_copied = copy(output_buffers, size_decrypted, net::buffer(data_ptr, data_size));
+          size_decrypted += size_copied;
+          stats_.plaintext_copied(data_size);
+          if (size_copied < data_size) {
+            stats_.decrypted_data_spilled();
+            decrypted_data_.fill(net::buffer(data_ptr + size_copied, data_size - size_copied));
+          }
+        }
       }
-    }
 
-    if (buffers_[3].BufferType == SECBUFFER_EXTRA) {
-      const auto extra_size = buffers_[3].cbBuffer;
-      std::memmove(encrypted_data_.data(), buffers_[3].pvBuffer, extra_size);
+      const auto extra_size = buffers_[3].BufferType == SECBUFFER_EXTRA ? buffers_[3].cbBuffer : 0;
+      offset_ += size - extra_size;
       buffers_[0].cbBuffer = extra_size;
-    } else {
-      buffers_[0].cbBuffer = 0;
-    }
+      buffers_[0].pvBuffer = (input_data() + offset_).data();
+
+      if (last_error_ == SEC_I_RENEGOTIATE) {
+        // Any remaining data belongs to the handshake and is handed
+        // over from the internal buffer.
+        move_to_encrypted_data();
+        buffers_[3].BufferType = SECBUFFER_EXTRA;
+        buffers_[3].pvBuffer = buffers_[0].pvBuffer;
+        buffers_[3].cbBuffer = buffers_[0].cbBuffer;
+        buffers_[0].cbBuffer = 0;
+        if (size_decrypted > 0) {
+          pending_status_ = SEC_I_RENEGOTIATE;
+          stats_.plaintext_read(size_decrypted);
+          return state::data_available;
+        }
+        return state::renegotiate_handshake;
+      }
+    } while (buffers_[0].cbBuffer > 0 && decrypted_data_.empty() &&
+             (output_buffer_.size() > 0 || size_decrypted < output_size));
 
-    if (last_error_ == SEC_I_RENEGOTIATE) {
-      buffers_[0].cbBuffer = 0;
-      return state::renegotiate_handshake;
+    if (size_decrypted == 0 && decrypted_data_.empty() && buffers_[0].cbBuffer == 0) {
+      // Only records without any application data were received
+      return start_read(output_buffers);
     }
 
+    // The output buffers are only valid until this operation completes
+    move_to_encrypted_data();
+    stats_.plaintext_read(size_decrypted);
     return state::data_available;
   }
 
   void size_read(std::size_t size) {
+    stats_.next_layer_read(size);
+    if (probing_) {
+      // Data has arrived on an idle stream, so it needs a buffer
+      // for the rest of the record again
+      probing_ = false;
+      allocate_encrypted_data();
+      std::memcpy(encrypted_data_.data(), probe_.data(), size);
+      buffers_[0].pvBuffer = encrypted_data_.data();
+    }
     buffers_[0].cbBuffer += static_cast<unsigned long>(size);
-    input_buffer = net::buffer(encrypted_data_) + buffers_[0].cbBuffer;
+    input_buffer = input_data() + offset_ + buffers_[0].cbBuffer;
+  }
+
+  // Must be called if reading from the next layer fails. Any part of a
+  // record already read into the buffers supplied by the user is
+  // moved to the internal buffer, as those buffers are no longer valid
+  // once the read operation completes.
+  void read_failed() {
+    move_to_encrypted_data();
+  }
+
+  // True if decrypted data is available without reading from the
+  // next layer or decrypting any records
+  bool has_decrypted_data() const {
+    return !decrypted_data_.empty();
+  }
+
+  // True if reading does not need to start by reading from the next
+  // layer as either decrypted data, the status of a record already
+  // decrypted or a complete record is available. The record may still
+  // turn out to contain no application data.
+  bool data_buffered() const {
+    if (has_decrypted_data() || pending_status_ != SEC_E_OK) {
+      return true;
+    }
+    const std::size_t size = buffers_[0].cbBuffer;
+    if (size < record_header_size) {
+      return false;
+    }
+    const auto header = static_cast<const unsigned char*>(buffers_[0].pvBuffer);
+    return size >= record_header_size + (static_cast<std::size_t>(header[3]) << 8 | header[4]);
+  }
+
+  // Frees the internal buffers whenever all data received has been
+  // decrypted and returned to the caller instead of keeping them for
+  // the next record. Reading then starts with only the header of the
+  // next record, so an idle stream holds no buffers while waiting for
+  // data from the next layer.
+  void set_release_idle_buffers(bool release) {
+    release_idle_buffers_ = release;
+  }
+
+  // Frees the internal buffers if releasing them while idle is
+  // enabled and they hold no data, eg. before waiting for the next
+  // layer without reading from it.
+  void release_buffers_if_idle() {
+    if (release_idle_buffers_ && buffers_[0].cbBuffer == 0 && decrypted_data_.empty()) {
+      encrypted_data_.release();
+      decrypted_data_.release();
+    }
   }
 
   std::size_t size_decrypted;
@@ -116,13 +254,153 @@ public:
   }
 
 private:
-  static constexpr std::size_t buffer_size = 0x10000;
+  // Header, maximum ciphertext expansion and maximum plaintext
+  // fragment size of a TLS record as defined by RFC 5246.
+  static constexpr std::size_t max_record_size = 5 + 0x800 + 0x4000;
+
+  // Size of the header of a TLS record which ends with the length of
+  // the rest of the record
+  static constexpr std::size_t record_header_size = 5;
+
+  // Upper limit on data read directly into a buffer supplied by the
+  // user as the size of a security buffer is 32 bits.
+  static constexpr std::size_t max_direct_read_size = 0x10000000;
+
+  template <class MutableBufferSequence>
+  static net::mutable_buffer first_buffer(const MutableBufferSequence& buffers) {
+    const auto begin = net::buffer_sequence_begin(buffers);
+    if (begin == net::buffer_sequence_end(buffers)) {
+      return net::mutable_buffer{};
+    }
+    return *begin;
+  }
+
+  // Copies data to the buffer sequence after the given number of
+  // bytes already copied to it.
+  template <class MutableBufferSequence>
+  static std::size_t copy(const MutableBufferSequence& buffers, std::size_t offset, net::const_buffer data) {
+    std::size_t size_copied = 0;
+    const auto end = net::buffer_sequence_end(buffers);
+    for (auto it = net::buffer_sequence_begin(buffers); it != end && data.size() > 0; ++it) {
+      net::mutable_buffer buffer(*it);
+      if (offset >= buffer.size()) {
+        offset -= buffer.size();
+        continue;
+      }
+      const auto size = net::buffer_copy(buffer + offset, data);
+      offset = 0;
+      data += size;
+      size_copied += size;
+    }
+    return size_copied;
+  }
+
+  // Starts reading a new record. If the first output buffer can hold
+  // a whole record, read into that buffer and decrypt in place
+  // instead of copying the decrypted data out of an internal buffer.
+  template <class MutableBufferSequence>
+  state start_read(const MutableBufferSequence& output_buffers) {
+    offset_ = 0;
+    probing_ = false;
+    const net::mutable_buffer output = first_buffer(output_buffers);
+    if (output.size() >= record_size_) {
+      output_buffer_ = net::buffer(output, max_direct_read_size);
+    } else if (release_idle_buffers_) {
+      encrypted_data_.release();
+      decrypted_data_.release();
+      probing_ = true;
+      buffers_[0].pvBuffer = probe_.data();
+      input_buffer = net::buffer(probe_);
+      return state::data_needed;
+    } else {
+      allocate_encrypted_data();
+    }
+    buffers_[0].pvBuffer = input_data().data();
+    input_buffer = input_data();
+    return state::data_needed;
+  }
+
+  // Makes room for reading the rest of an incomplete record
+  void prepare_read() {
+    if (output_buffer_.size() > 0 && offset_ + buffers_[0].cbBuffer == output_buffer_.size()) {
+      move_to_encrypted_data();
+    }
+    if (output_buffer_.size() == 0) {
+      if (offset_ > 0) {
+        std::memmove(encrypted_data_.data(), encrypted_data_.data() + offset_, buffers_[0].cbBuffer);
+        offset_ = 0;
+      }
+      if (buffers_[0].cbBuffer == encrypted_data_.size()) {
+        // The peer sent a record larger than the maximum message size
+        // reported by the security package, eg. due to extra padding.
+        // Make room for the largest record allowed by the TLS standard.
+        WINTLS_ASSERT_MSG(buffers_[0].cbBuffer < max_record_size, "buffer not large enough for tls record");
+        encrypted_data_.resize(max_record_size);
+      }
+    }
+    buffers_[0].pvBuffer = (input_data() + offset_).data();
+    input_buffer = input_data() + offset_ + buffers_[0].cbBuffer;
+  }
+
+  bool query_record_size() {
+    if (record_size_ == 0) {
+      SecPkgContext_StreamSizes stream_sizes{};
+      last_error_ = detail::sspi_functions::QueryContextAttributesA(ctxt_handle_.get(), SECPKG_ATTR_STREAM_SIZES, &stream_sizes);
+      if (last_error_ != SEC_E_OK) {
+        return false;
+      }
+      record_size_ = stream_sizes.cbHeader + stream_sizes.cbMaximumMessage + stream_sizes.cbTrailer;
+    }
+    return true;
+  }
+
+  // The buffer for encrypted data is allocated on first use, sized to
+  // hold a single record of the maximum size supported by the
+  // negotiated security context.
+  void allocate_encrypted_data() {
+    if (encrypted_data_.size() < record_size_) {
+      encrypted_data_.resize(record_size_);
+    }
+  }
+
+  // The buffer currently receiving encrypted data, either the output
+  // buffer supplied by the user or the internal buffer.
+  net::mutable_buffer input_data() {
+    return output_buffer_.size() > 0 ? output_buffer_ : encrypted_data_.asio_buffer();
+  }
+
+  // Moves any data not yet decrypted from the output buffer supplied
+  // by the user to the start of the internal buffer.
+  void move_to_encrypted_data() {
+    if (output_buffer_.size() == 0) {
+      return;
+    }
+    if (buffers_[0].cbBuffer > 0) {
+      allocate_encrypted_data();
+      if (encrypted_data_.size() < buffers_[0].cbBuffer) {
+        encrypted_data_.resize(buffers_[0].cbBuffer);
+      }
+      std::memmove(encrypted_data_.data(), (output_buffer_ + offset_).data(), buffers_[0].cbBuffer);
+      buffers_[0].pvBuffer = encrypted_data_.data();
+    }
+    input_buffer = encrypted_data_.asio_buffer() + buffers_[0].cbBuffer;
+    output_buffer_ = net::mutable_buffer{};
+    offset_ = 0;
+  }
 
   ctxt_handle& ctxt_handle_;
+  statistics& stats_;
   SECURITY_STATUS last_error_;
   decrypt_buffers buffers_;
-  std::array<char, buffer_size> encrypted_data_;
-  decrypted_data_buffer<buffer_size> decrypted_data_;
+  std::size_t record_size_ = 0;
+  std::size_t offset_ = 0;
+  SECURITY_STATUS pending_status_ = SEC_E_OK;
+  stream_buffer encrypted_data_;
+  decrypted_data_buffer decrypted_data_;
+  net::mutable_buffer output_buffer_;
+  bool release_idle_buffers_ = false;
+  bool probing_ = false;
+  std::array<char, record_header_size> probe_{};
 };
 
 } // namespace detail
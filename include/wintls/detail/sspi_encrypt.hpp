@@ -10,41 +10,271 @@
 
 #include <wintls/detail/config.hpp>
 #include <wintls/detail/encrypt_buffers.hpp>
+#include <wintls/detail/record_sizer.hpp>
 #include <wintls/detail/sspi_sec_handle.hpp>
+#include <wintls/detail/statistics.hpp>
+#include <wintls/detail/stream_buffer.hpp>
+
+#include <algorithm>
+#include <array>
+#include <memory>
 
 namespace wintls {
 namespace detail {
 
+// A single record laid out in the memory of the caller to be
+// encrypted in place
+struct in_place_record {
+  net::mutable_buffer buffer;
+  std::size_t size;
+};
+
+// The encrypted records to write with a single write to the next
+// layer. Empty buffers are left out so the next layer is only given
+// buffers with data to write.
+class record_buffers {
+public:
+  using value_type = net::const_buffer;
+  using const_iterator = const net::const_buffer*;
+
+  record_buffers(const net::const_buffer& flushed, const net::const_buffer& record) {
+    if (flushed.size() > 0) {
+      buffers_[count_++] = flushed;
+    }
+    if (record.size() > 0) {
+      buffers_[count_++] = record;
+    }
+  }
+
+  const_iterator begin() const {
+    return buffers_.data();
+  }
+
+  const_iterator end() const {
+    return buffers_.data() + count_;
+  }
+
+private:
+  std::array<net::const_buffer, 2> buffers_;
+  std::size_t count_ = 0;
+};
+
 class sspi_encrypt {
 public:
-  sspi_encrypt(ctxt_handle& ctxt_handle)
-    : buffers(ctxt_handle)
-    , ctxt_handle_(ctxt_handle) {
+  sspi_encrypt(ctxt_handle& ctxt_handle, const std::shared_ptr<buffer_pool>& pool, statistics& stats)
+    : buffers(ctxt_handle, pool)
+    , ctxt_handle_(ctxt_handle)
+    , stats_(stats)
+    , sizer_(stats)
+    , corked_record_(pool) {
+  }
+
+  // Encrypts the data unless corked, in which case it is appended to
+  // the corked record instead. That record is only encrypted once
+  // full, so there may be no record to write afterwards.
+  template <typename ConstBufferSequence>
+  std::size_t write(const ConstBufferSequence& buf, wintls::error_code& ec) {
+    if (!corked_) {
+      return (*this)(buf, ec);
+    }
+    flushed_ = {};
+    record_ = {};
+    const auto sizes = layout(ec);
+    if (ec) {
+      return 0;
+    }
+    // The corked record is laid out for being encrypted in place
+    const auto record_size = sizes.header_size + sizes.max_data_size + sizes.trailer_size;
+    if (corked_record_.size() < record_size) {
+      corked_record_.resize(record_size);
+    }
+    if (corked_size_ == 0) {
+      sizer_.start_write();
+    }
+    const auto max_size = sizer_.record_size(sizes.max_data_size);
+    if (corked_size_ >= max_size) {
+      // The record size has been reduced since the data was corked,
+      // so the corked record is full already. It is written ahead of
+      // the data which is encrypted without being corked.
+      return (*this)(buf, ec);
+    }
+    const auto size = net::buffer_copy(net::buffer(corked_record_.data() + sizes.header_size + corked_size_,
+                                                   max_size - corked_size_),
+                                       buf);
+    stats_.plaintext_copied(size);
+    corked_size_ += size;
+    if (corked_size_ == max_size) {
+      flush(ec);
+      if (ec) {
+        return 0;
+      }
+    }
+    return size;
+  }
+
+  std::size_t write(const in_place_record& in_place, wintls::error_code& ec) {
+    return (*this)(in_place, ec);
+  }
+
+  // Encrypts the data of the corked record, if any
+  void flush(wintls::error_code& ec) {
+    flushed_ = {};
+    record_ = {};
+    flush_corked(ec);
+  }
+
+  // Data already corked stays corked when disabling corking. It is
+  // written ahead of the data of the next write or when flushed.
+  void set_corked(bool corked) {
+    corked_ = corked;
   }
 
+  // Encrypts the data without corking it, after encrypting any data
+  // corked previously so it is written first
   template <typename ConstBufferSequence>
   std::size_t operator()(const ConstBufferSequence& buf, wintls::error_code& ec) {
+    return (*this)(buf, ec, max_records_);
+  }
+
+  template <typename ConstBufferSequence>
+  std::size_t operator()(const ConstBufferSequence& buf, wintls::error_code& ec, std::size_t max_records) {
+    flushed_ = {};
+    record_ = {};
+    flush_corked(ec);
+    if (ec) {
+      return 0;
+    }
+
     SECURITY_STATUS sc = SEC_E_OK;
 
-    std::size_t size_encrypted = buffers(buf, sc);
+    const auto size = net::buffer_size(buf);
+    const auto max_data_size = buffers.layout(sc).max_data_size;
+    if (sc == SEC_E_OK) {
+      sizer_.start_write();
+      buffers.reset(max_records, size, sizer_.record_size(max_data_size), sc);
+    }
     if (sc != SEC_E_OK) {
       ec = error::make_error_code(sc);
       return 0;
     }
 
-    sc = detail::sspi_functions::EncryptMessage(ctxt_handle_.get(), 0, buffers.desc(), 0);
+    buffer_sequence_cursor<ConstBufferSequence> input(buf);
+    std::size_t size_encrypted = 0;
+    do {
+      const auto size_consumed = buffers(input, sizer_.record_size(max_data_size));
+      size_encrypted += size_consumed;
+      stats_.plaintext_copied(size_consumed);
+      sc = detail::sspi_functions::EncryptMessage(ctxt_handle_.get(), 0, buffers.desc(), 0);
+      if (sc != SEC_E_OK) {
+        ec = error::make_error_code(sc);
+        return 0;
+      }
+      buffers.commit();
+      stats_.record_encrypted();
+      sizer_.record_encrypted(size_consumed);
+    } while (size_encrypted < size && !buffers.full());
+
+    record_ = buffers.record();
+    stats_.plaintext_written(size_encrypted);
+    return size_encrypted;
+  }
+
+  std::size_t operator()(const in_place_record& in_place, wintls::error_code& ec) {
+    flushed_ = {};
+    record_ = {};
+    flush_corked(ec);
+    if (ec) {
+      return 0;
+    }
+    record_ = encrypt_in_place(in_place, ec);
+    return ec ? 0 : in_place.size;
+  }
+
+  // The records encrypted by the last call, ready to be written,
+  // preceded by the corked record if it was encrypted by the call
+  record_buffers record() const {
+    return {flushed_, record_};
+  }
+
+  record_layout layout(wintls::error_code& ec) {
+    SECURITY_STATUS sc = SEC_E_OK;
+    const auto result = buffers.layout(sc);
     if (sc != SEC_E_OK) {
       ec = error::make_error_code(sc);
-      return 0;
     }
+    return result;
+  }
 
-    return size_encrypted;
+  void size_written(std::size_t size) {
+    stats_.next_layer_written(size);
+    if (release_idle_buffers_) {
+      flushed_ = {};
+      record_ = {};
+      buffers.release();
+      if (corked_size_ == 0) {
+        corked_record_.release();
+      }
+    }
+  }
+
+  // Frees the buffers holding encrypted records and the empty corked
+  // record once written instead of keeping them for the next write
+  void set_release_idle_buffers(bool release) {
+    release_idle_buffers_ = release;
+  }
+
+  void set_record_sizing(const record_sizing& sizing) {
+    sizer_.set(sizing);
+  }
+
+  void set_max_records(std::size_t max_records) {
+    max_records_ = std::max<std::size_t>(max_records, 1);
   }
 
   encrypt_buffers buffers;
 
 private:
+  net::const_buffer encrypt_in_place(const in_place_record& in_place, wintls::error_code& ec) {
+    SECURITY_STATUS sc = SEC_E_OK;
+    buffers.in_place(in_place.buffer, in_place.size, sc);
+    if (sc == SEC_E_OK) {
+      sc = detail::sspi_functions::EncryptMessage(ctxt_handle_.get(), 0, buffers.desc(), 0);
+    }
+    if (sc != SEC_E_OK) {
+      ec = error::make_error_code(sc);
+      return {};
+    }
+    stats_.record_encrypted();
+    stats_.plaintext_written(in_place.size);
+    return buffers.in_place_record();
+  }
+
+  // Encrypts the corked record in place. The data is only removed
+  // from the record once encrypted, as it has already been reported
+  // as written to the caller.
+  void flush_corked(wintls::error_code& ec) {
+    if (corked_size_ == 0) {
+      return;
+    }
+    const auto size = corked_size_;
+    flushed_ = encrypt_in_place(in_place_record{corked_record_.asio_buffer(), size}, ec);
+    if (ec) {
+      return;
+    }
+    corked_size_ = 0;
+    sizer_.record_encrypted(size);
+  }
+
   ctxt_handle& ctxt_handle_;
+  statistics& stats_;
+  record_sizer sizer_;
+  std::size_t max_records_ = 1;
+  net::const_buffer flushed_;
+  net::const_buffer record_;
+  stream_buffer corked_record_;
+  std::size_t corked_size_ = 0;
+  bool corked_ = false;
+  bool release_idle_buffers_ = false;
 };
 
 } // namespace detail
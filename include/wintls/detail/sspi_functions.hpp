@@ -11,11 +11,21 @@
 #include <wintls/detail/assert.hpp>
 #include <wintls/detail/sspi_types.hpp>
 
+#include <atomic>
+
 namespace wintls {
 namespace detail {
 namespace sspi_functions {
 
+inline std::atomic<SecurityFunctionTableA*>& custom_function_table() {
+  static std::atomic<SecurityFunctionTableA*> table{nullptr};
+  return table;
+}
+
 inline SecurityFunctionTableA* sspi_function_table() {
+  if (auto table = custom_function_table().load(std::memory_order_acquire)) {
+    return table;
+  }
   static SecurityFunctionTableA* impl = InitSecurityInterfaceA();
   // TODO: Figure out some way to signal this to the user instead of aborting
   WINTLS_ASSERT_MSG(impl != nullptr, "Unable to initialize SecurityFunctionTable");
@@ -16,10 +16,12 @@
 #include <wintls/detail/handshake_output_buffers.hpp>
 #include <wintls/detail/sspi_context_buffer.hpp>
 #include <wintls/detail/sspi_sec_handle.hpp>
+#include <wintls/detail/statistics.hpp>
+#include <wintls/detail/stream_buffer.hpp>
 
 #include <wintls/handshake_type.hpp>
 
-#include <array>
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -36,102 +38,22 @@ public:
     error                  // handshake error
   };
 
-  sspi_handshake(context& context, ctxt_handle& ctxt_handle, cred_handle& cred_handle)
+  sspi_handshake(context& context, ctxt_handle& ctxt_handle, std::shared_ptr<cred_handle>& cred_handle, const std::shared_ptr<buffer_pool>& pool, statistics& stats)
     : context_(context)
     , ctxt_handle_(ctxt_handle)
     , cred_handle_(cred_handle)
+    , stats_(stats)
     , last_error_(SEC_E_OK)
-    , in_buffer_(net::buffer(input_data_)) {
-    input_buffers_[0].pvBuffer = reinterpret_cast<void*>(input_data_.data());
+    , input_data_(pool) {
   }
 
   void operator()(handshake_type type) {
+    stats_.handshake_started();
     handshake_type_ = type;
+    allocate_input_buffer();
 
-    TLS_PARAMETERS tls_parameters{};
-    SCH_CREDENTIALS credentials{};
-    SCHANNEL_CRED creds{};
-    void* cred = nullptr;
-
-    auto usage = [this]() {
-      switch (handshake_type_) {
-        case handshake_type::client:
-          return SECPKG_CRED_OUTBOUND;
-        case handshake_type::server:
-          return SECPKG_CRED_INBOUND;
-      }
-      WINTLS_UNREACHABLE_RETURN(0);
-    }();
-
-    auto server_cert = context_.server_cert();
-    bool is_tlsv13 = [this]() {
-      switch (context_.method_) {
-        case method::tlsv13:
-        case method::tlsv13_client:
-        case method::tlsv13_server:
-          return true;
-        default:
-          return false;
-      }
-      WINTLS_UNREACHABLE_RETURN(0);
-    }();
-
-    DWORD version = is_tlsv13 ? SCH_CREDENTIALS_VERSION : SCHANNEL_CRED_VERSION;
-    DWORD flags = is_tlsv13 ? SCH_USE_STRONG_CRYPTO : (SCH_CRED_MANUAL_CRED_VALIDATION | SCH_CRED_NO_DEFAULT_CREDS);
-    DWORD protocols = static_cast<DWORD>(context_.method_);
-
-    // If revocation checking is enables, specify SCH_CRED_REVOCATION_CHECK_CHAIN_EXCLUDE_ROOT
-    // to cause the TLS certificate status request extension (commonly known as OCSP stapling)
-    // to be sent. This flag matches the CERT_CHAIN_REVOCATION_CHECK_CHAIN_EXCLUDE_ROOT
-    // flag that we pass to the CertGetCertificateChain calls during our manual authentication.
-    if (check_revocation_) {
-      flags |= SCH_CRED_REVOCATION_CHECK_CHAIN_EXCLUDE_ROOT;
-    }
-
-    DWORD num_creds = 0;
-    decltype(&server_cert) creds_list = nullptr;
-
-    if (handshake_type_ == handshake_type::server && server_cert != nullptr) {
-      num_creds = 1;
-      creds_list = &server_cert;
-    }
-
-    // TODO: rename server_cert field since it is also used for client cert.
-    // Note: if client cert is set, sspi will auto validate server cert with it.
-    // Even though verify_server_certificate_ in context is set to false.
-    if (handshake_type_ == handshake_type::client && server_cert != nullptr) {
-      num_creds = 1;
-      creds_list = &server_cert;
-    }
-
-    if (!is_tlsv13) {
-      cred = &creds;
-      creds.dwVersion = version;
-      creds.grbitEnabledProtocols = protocols;
-      creds.dwFlags = flags;
-      creds.cCreds = num_creds;
-      creds.paCred = creds_list;
-    } else {
-      cred = &credentials;
-      credentials.dwVersion = version;
-      credentials.dwFlags = flags;
-      credentials.cTlsParameters = 1;
-      credentials.pTlsParameters = &tls_parameters;
-      credentials.pTlsParameters->grbitDisabledProtocols = ~protocols;
-      credentials.cCreds = num_creds;
-      credentials.paCred = creds_list;
-    }
-
-    TimeStamp expiry;
-    last_error_ = detail::sspi_functions::AcquireCredentialsHandleA(nullptr,
-                                                                   const_cast<SEC_CHAR*>(UNISP_NAME),
-                                                                   static_cast<unsigned>(usage),
-                                                                   nullptr,
-                                                                   cred,
-                                                                   nullptr,
-                                                                   nullptr,
-                                                                   cred_handle_.get(),
-                                                                   &expiry);
+    session_resumed_ = false;
+    cred_handle_ = context_.credentials(handshake_type_, check_revocation_, session_key(), last_error_);
     if (last_error_ != SEC_E_OK) {
       return;
     }
@@ -141,7 +63,7 @@ public:
         DWORD out_flags = 0;
 
         handshake_output_buffers buffers;
-        last_error_ = detail::sspi_functions::InitializeSecurityContextA(cred_handle_.get(),
+        last_error_ = detail::sspi_functions::InitializeSecurityContextA(cred_handle_->get(),
                                                                         nullptr,
                                                                         const_cast<SEC_CHAR*>(server_hostname_.c_str()),
                                                                         client_context_flags,
@@ -165,6 +87,7 @@ public:
 
   state operator()() {
     if (last_error_ == SEC_E_OK) {
+      free_input_buffer();
       return state::done;
     }
     if (last_error_ != SEC_I_CONTINUE_NEEDED && last_error_ != SEC_E_INCOMPLETE_MESSAGE) {
@@ -186,7 +109,7 @@ public:
 
     switch(handshake_type_) {
       case handshake_type::client:
-        last_error_ = detail::sspi_functions::InitializeSecurityContextA(cred_handle_.get(),
+        last_error_ = detail::sspi_functions::InitializeSecurityContextA(cred_handle_->get(),
                                                                         ctxt_handle_.get(),
                                                                         const_cast<SEC_CHAR*>(server_hostname_.c_str()),
                                                                         client_context_flags,
@@ -205,7 +128,7 @@ public:
         if (context_.verify_server_certificate_) {
           f_context_req |= ASC_REQ_MUTUAL_AUTH;
         }
-        last_error_ = detail::sspi_functions::AcceptSecurityContext(cred_handle_.get(),
+        last_error_ = detail::sspi_functions::AcceptSecurityContext(cred_handle_->get(),
                                                                     ctxt_handle_ ? ctxt_handle_.get() : nullptr,
                                                                     input_buffers_.desc(),
                                                                     f_context_req,
@@ -220,12 +143,12 @@ public:
       // Some data needs to be reused for the next call, move that to the front for reuse
       const auto previous_size = input_buffers_[0].cbBuffer;
       const auto extra_size = input_buffers_[1].cbBuffer;
-      const auto extra_data_begin = input_data_.begin() + previous_size - extra_size;
-      const auto extra_data_end = input_data_.begin() + previous_size;
+      const auto extra_data_begin = input_data_.data() + previous_size - extra_size;
+      const auto extra_data_end = input_data_.data() + previous_size;
 
-      std::move(extra_data_begin, extra_data_end, input_data_.begin());
+      std::move(extra_data_begin, extra_data_end, input_data_.data());
       input_buffers_[0].cbBuffer = extra_size;
-      in_buffer_ = net::buffer(input_data_) + extra_size;
+      in_buffer_ = input_data_.asio_buffer() + extra_size;
 
       WINTLS_ASSERT_MSG(in_buffer_.size() > 0, "buffer not large enough for tls handshake message");
       if (last_error_ == SEC_E_OK) {
@@ -238,7 +161,7 @@ public:
       return state::data_needed;
     } else {
       input_buffers_[0].cbBuffer = 0;
-      in_buffer_ = net::buffer(input_data_);
+      in_buffer_ = input_data_.asio_buffer();
     }
 
     bool has_buffer_output = out_buffers[0].cbBuffer != 0 && out_buffers[0].pvBuffer != nullptr;
@@ -272,6 +195,7 @@ public:
             return state::data_available;
           }
         }
+        free_input_buffer();
         return state::done;
       }
 
@@ -288,15 +212,13 @@ public:
 
   void load_renegotiate_extra_data(wintls::detail::sspi_buffer& extra_buffer) {
     last_error_ = SEC_I_CONTINUE_NEEDED;
-    input_buffers_[0].cbBuffer = 0;
-    input_buffers_[0].pvBuffer = reinterpret_cast<void*>(input_data_.data());
-    in_buffer_ = net::buffer(input_data_);
+    allocate_input_buffer();
 
     if (extra_buffer.BufferType == SECBUFFER_EXTRA) {
       auto len = extra_buffer.cbBuffer;
       input_buffers_[0].cbBuffer = len;
       std::memmove(input_buffers_[0].pvBuffer, extra_buffer.pvBuffer, len);
-      in_buffer_ = net::buffer(input_data_) + len;
+      in_buffer_ = input_data_.asio_buffer() + len;
     }
   }
 
@@ -304,15 +226,31 @@ public:
     return input_buffers_[0];
   }
 
+  // Releases the input buffer once any extra data received after the
+  // handshake has been handed over with get_renegotiate_data_buffer.
+  void free_input_buffer() {
+    input_data_.release();
+    input_buffers_[0].pvBuffer = nullptr;
+    input_buffers_[0].cbBuffer = 0;
+    in_buffer_ = net::mutable_buffer{};
+  }
+
   void size_written(std::size_t size) {
     (void)(size);
     assert(size == out_buffer_.size());
     out_buffer_ = sspi_context_buffer{};
+    stats_.next_layer_written(size);
+    awaiting_reply_ = true;
   }
 
   void size_read(std::size_t size) {
+    stats_.next_layer_read(size);
+    if (awaiting_reply_) {
+      stats_.handshake_round_trip();
+      awaiting_reply_ = false;
+    }
     input_buffers_[0].cbBuffer += static_cast<ULONG>(size);
-    in_buffer_ = net::buffer(input_data_) + input_buffers_[0].cbBuffer;
+    in_buffer_ = input_data_.asio_buffer() + input_buffers_[0].cbBuffer;
   }
 
   net::const_buffer out_buffer() {
@@ -331,11 +269,34 @@ public:
     server_hostname_ = hostname;
   }
 
+  void set_server_port(std::uint16_t port) {
+    server_port_ = port;
+  }
+
+  bool session_resumed() const {
+    return session_resumed_;
+  }
+
   void set_certificate_revocation_check(bool check) {
     check_revocation_ = check;
   }
 
+  bool verifies_remote_certificate() const {
+    return context_.verify_server_certificate_;
+  }
+
   SECURITY_STATUS manual_auth(){
+    SecPkgContext_SessionInfo session_info{};
+    if (detail::sspi_functions::QueryContextAttributesA(ctxt_handle_.get(), SECPKG_ATTR_SESSION_INFO, &session_info) == SEC_E_OK) {
+      session_resumed_ = (session_info.dwFlags & SSL_SESSION_RECONNECT) != 0;
+    }
+    const auto status = verify_remote_certificate();
+    stats_.handshake_done(session_resumed_);
+    return status;
+  }
+
+private:
+  SECURITY_STATUS verify_remote_certificate() {
     if (!context_.verify_server_certificate_) {
       return SEC_E_OK;
     }
@@ -349,19 +310,43 @@ public:
     return last_error_;
   }
 
-private:
+  // Clients resume sessions with the server they are connecting to
+  std::string session_key() const {
+    if (handshake_type_ != handshake_type::client || server_hostname_.empty()) {
+      return {};
+    }
+    return server_hostname_ + ':' + std::to_string(server_port_);
+  }
+
+  // Handshake messages are only buffered while handshaking so the
+  // buffer is allocated when a handshake starts and freed when done.
+  void allocate_input_buffer() {
+    if (input_data_.empty()) {
+      input_data_.resize(buffer_size);
+    }
+    input_buffers_[0].pvBuffer = reinterpret_cast<void*>(input_data_.data());
+    input_buffers_[0].cbBuffer = 0;
+    in_buffer_ = input_data_.asio_buffer();
+  }
+
+  static constexpr std::size_t buffer_size = 0x10000;
+
   context& context_;
   ctxt_handle& ctxt_handle_;
-  cred_handle& cred_handle_;
+  std::shared_ptr<cred_handle>& cred_handle_;
+  statistics& stats_;
 
   SECURITY_STATUS last_error_;
   handshake_type handshake_type_ = handshake_type::client;
-  std::array<char, 0x10000> input_data_;
+  stream_buffer input_data_;
   sspi_context_buffer out_buffer_;
   net::mutable_buffer in_buffer_;
   handshake_input_buffers input_buffers_;
   std::string server_hostname_;
+  std::uint16_t server_port_ = 0;
   bool check_revocation_ = false;
+  bool session_resumed_ = false;
+  bool awaiting_reply_ = false;
 };
 
 } // namespace detail
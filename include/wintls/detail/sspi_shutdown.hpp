@@ -14,17 +14,20 @@
 #include <wintls/detail/shutdown_buffers.hpp>
 #include <wintls/detail/sspi_context_buffer.hpp>
 #include <wintls/detail/sspi_sec_handle.hpp>
+#include <wintls/detail/statistics.hpp>
 
 #include <cassert>
+#include <memory>
 
 namespace wintls {
 namespace detail {
 
 class sspi_shutdown {
 public:
-  sspi_shutdown(ctxt_handle& ctxt_handle, cred_handle& cred_handle)
+  sspi_shutdown(ctxt_handle& ctxt_handle, std::shared_ptr<cred_handle>& cred_handle, statistics& stats)
     : ctxt_handle_(ctxt_handle)
-    , cred_handle_(cred_handle) {
+    , cred_handle_(cred_handle)
+    , stats_(stats) {
   }
 
   wintls::error_code operator()() {
@@ -36,7 +39,7 @@ public:
     }
 
     DWORD out_flags = 0;
-    sc = detail::sspi_functions::InitializeSecurityContextA(cred_handle_.get(),
+    sc = detail::sspi_functions::InitializeSecurityContextA(cred_handle_ ? cred_handle_->get() : nullptr,
                                                            ctxt_handle_.get(),
                                                            nullptr,
                                                            client_context_flags,
@@ -63,12 +66,14 @@ public:
   void size_written(std::size_t size) {
     (void)(size);
     assert(size == buffer_.size());
+    stats_.next_layer_written(size);
     buffer_ = sspi_context_buffer{};
   }
 
 private:
   ctxt_handle& ctxt_handle_;
-  cred_handle& cred_handle_;
+  std::shared_ptr<cred_handle>& cred_handle_;
+  statistics& stats_;
   sspi_context_buffer buffer_;
 };
 
@@ -13,6 +13,12 @@
 #include <wintls/detail/sspi_decrypt.hpp>
 #include <wintls/detail/sspi_shutdown.hpp>
 #include <wintls/detail/sspi_sec_handle.hpp>
+#include <wintls/detail/statistics.hpp>
+#include <wintls/detail/write_queue.hpp>
+
+#include <memory>
+#include <mutex>
+#include <utility>
 
 namespace wintls {
 namespace detail {
@@ -20,10 +26,10 @@ namespace detail {
 class sspi_stream {
 public:
   sspi_stream(context& ctx)
-    : handshake(ctx, ctxt_handle_, cred_handle_)
-    , encrypt(ctxt_handle_)
-    , decrypt(ctxt_handle_)
-    , shutdown(ctxt_handle_, cred_handle_) {
+    : handshake(ctx, ctxt_handle_, cred_handle_, ctx.buffer_pool_, stats)
+    , encrypt(ctxt_handle_, ctx.buffer_pool_, stats)
+    , decrypt(ctxt_handle_, ctx.buffer_pool_, stats)
+    , shutdown(ctxt_handle_, cred_handle_, stats) {
   }
 
   sspi_stream(sspi_stream&&) = delete;
@@ -31,13 +37,59 @@ public:
 
 private:
   ctxt_handle ctxt_handle_;
-  cred_handle cred_handle_;
+  std::shared_ptr<cred_handle> cred_handle_;
 
 public:
+  statistics stats;
   sspi_handshake handshake;
   sspi_encrypt encrypt;
   sspi_decrypt decrypt;
   sspi_shutdown shutdown;
+  write_queue queued_writes;
+  // Held by synchronous writes and while renegotiating, allowing one
+  // thread to read while another one is writing
+  std::mutex write_mutex;
+};
+
+// Owns the state of a stream. Queued writes share the state to keep it
+// alive while writing to the next layer, so the queue is closed once
+// the stream no longer owns it.
+class sspi_stream_owner {
+public:
+  explicit sspi_stream_owner(context& ctx)
+    : stream_(std::make_shared<sspi_stream>(ctx)) {
+  }
+
+  sspi_stream_owner(sspi_stream_owner&&) noexcept = default;
+
+  sspi_stream_owner& operator=(sspi_stream_owner&& other) noexcept {
+    if (this != &other) {
+      close();
+      stream_ = std::move(other.stream_);
+    }
+    return *this;
+  }
+
+  ~sspi_stream_owner() {
+    close();
+  }
+
+  sspi_stream* operator->() const noexcept {
+    return stream_.get();
+  }
+
+  const std::shared_ptr<sspi_stream>& get() const noexcept {
+    return stream_;
+  }
+
+private:
+  void close() noexcept {
+    if (stream_) {
+      stream_->queued_writes.close();
+    }
+  }
+
+  std::shared_ptr<sspi_stream> stream_;
 };
 
 } // namespace detail
@@ -0,0 +1,135 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_DETAIL_STATISTICS_HPP
+#define WINTLS_DETAIL_STATISTICS_HPP
+
+#include <wintls/stream_statistics.hpp>
+
+#include <chrono>
+#include <cstddef>
+
+namespace wintls {
+namespace detail {
+
+#ifdef WINTLS_ENABLE_STATISTICS
+constexpr bool statistics_enabled = true;
+#else // WINTLS_ENABLE_STATISTICS
+constexpr bool statistics_enabled = false;
+#endif // !WINTLS_ENABLE_STATISTICS
+
+// Counts the operations performed by a stream. The layout does not
+// depend on WINTLS_ENABLE_STATISTICS, so code compiled with and
+// without it can be linked together. Unless enabled the counters are
+// never updated, allowing all calls to be optimized away.
+class statistics {
+public:
+  void plaintext_read(std::size_t size) {
+    if (statistics_enabled) {
+      stats_.plaintext_bytes_read += size;
+    }
+  }
+
+  void plaintext_written(std::size_t size) {
+    if (statistics_enabled) {
+      stats_.plaintext_bytes_written += size;
+    }
+  }
+
+  void plaintext_copied(std::size_t size) {
+    if (statistics_enabled) {
+      stats_.plaintext_bytes_copied += size;
+    }
+  }
+
+  void next_layer_read(std::size_t size) {
+    if (statistics_enabled) {
+      ++stats_.next_layer_reads;
+      stats_.ciphertext_bytes_read += size;
+    }
+  }
+
+  void next_layer_written(std::size_t size) {
+    if (statistics_enabled) {
+      ++stats_.next_layer_writes;
+      stats_.ciphertext_bytes_written += size;
+    }
+  }
+
+  void record_encrypted() {
+    if (statistics_enabled) {
+      ++stats_.records_encrypted;
+    }
+  }
+
+  void record_decrypted() {
+    if (statistics_enabled) {
+      ++stats_.records_decrypted;
+    }
+  }
+
+  void small_record_encrypted() {
+    if (statistics_enabled) {
+      ++stats_.small_records_encrypted;
+    }
+  }
+
+  void record_sizing_reset() {
+    if (statistics_enabled) {
+      ++stats_.record_sizing_resets;
+    }
+  }
+
+  void incomplete_record() {
+    if (statistics_enabled) {
+      ++stats_.incomplete_records;
+    }
+  }
+
+  void decrypted_data_spilled() {
+    if (statistics_enabled) {
+      ++stats_.decrypted_data_spills;
+    }
+  }
+
+  void handshake_round_trip() {
+    if (statistics_enabled) {
+      ++stats_.handshake_round_trips;
+    }
+  }
+
+  void handshake_started() {
+    if (statistics_enabled) {
+      handshake_start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  void handshake_done(bool session_resumed) {
+    if (!statistics_enabled) {
+      return;
+    }
+    ++stats_.handshakes;
+    if (session_resumed) {
+      ++stats_.sessions_resumed;
+    }
+    if (handshake_start_ != std::chrono::steady_clock::time_point{}) {
+      stats_.handshake_time = std::chrono::steady_clock::now() - handshake_start_;
+      handshake_start_ = std::chrono::steady_clock::time_point{};
+    }
+  }
+
+  stream_statistics snapshot() const {
+    return stats_;
+  }
+
+private:
+  stream_statistics stats_;
+  std::chrono::steady_clock::time_point handshake_start_;
+};
+
+} // namespace detail
+} // namespace wintls
+
+#endif // WINTLS_DETAIL_STATISTICS_HPP
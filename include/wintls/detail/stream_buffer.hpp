@@ -0,0 +1,94 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_DETAIL_STREAM_BUFFER_HPP
+#define WINTLS_DETAIL_STREAM_BUFFER_HPP
+
+#include <wintls/buffer_pool.hpp>
+
+#include <wintls/detail/config.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+namespace wintls {
+namespace detail {
+
+// Contiguous buffer owned by a stream, allocated from a buffer pool
+// if the context has one or from the heap otherwise. Growing the
+// buffer preserves its contents.
+class stream_buffer {
+public:
+  explicit stream_buffer(std::shared_ptr<buffer_pool> pool = nullptr)
+    : pool_(std::move(pool)) {
+  }
+
+  stream_buffer(const stream_buffer&) = delete;
+  stream_buffer& operator=(const stream_buffer&) = delete;
+
+  ~stream_buffer() {
+    release();
+  }
+
+  char* data() {
+    return data_;
+  }
+
+  const char* data() const {
+    return data_;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  net::mutable_buffer asio_buffer() {
+    return net::buffer(data_, size_);
+  }
+
+  void resize(std::size_t size) {
+    if (size > capacity_) {
+      const auto capacity = pool_ ? buffer_pool::capacity(size) : size;
+      auto data = pool_ ? pool_->allocate(capacity) : new char[capacity];
+      if (size_ > 0) {
+        std::memcpy(data, data_, size_);
+      }
+      release();
+      data_ = data;
+      capacity_ = capacity;
+    }
+    size_ = size;
+  }
+
+  // Frees the memory used by the buffer
+  void release() {
+    if (data_ != nullptr) {
+      if (pool_) {
+        pool_->deallocate(data_, capacity_);
+      } else {
+        delete[] data_;
+      }
+    }
+    data_ = nullptr;
+    size_ = 0;
+    capacity_ = 0;
+  }
+
+private:
+  std::shared_ptr<buffer_pool> pool_;
+  char* data_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t capacity_ = 0;
+};
+
+} // namespace detail
+} // namespace wintls
+
+#endif // WINTLS_DETAIL_STREAM_BUFFER_HPP
@@ -0,0 +1,123 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_DETAIL_VERIFICATION_CACHE_HPP
+#define WINTLS_DETAIL_VERIFICATION_CACHE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace wintls {
+namespace detail {
+
+// Bounded cache of successful certificate verifications. The least
+// recently used entry is evicted when the cache is full and entries
+// expire a fixed time after being added.
+class verification_cache {
+public:
+  using clock = std::chrono::steady_clock;
+
+  // Disables the cache when max_entries is zero
+  void configure(std::size_t max_entries, clock::duration ttl) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_entries_ = max_entries;
+    ttl_ = ttl;
+    while (entries_.size() > max_entries_) {
+      evict();
+    }
+  }
+
+  bool enabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return max_entries_ > 0;
+  }
+
+  bool find(const std::string& key, clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      ++misses_;
+      return false;
+    }
+    if (now >= it->second->expires) {
+      entries_.erase(it->second);
+      index_.erase(it);
+      ++misses_;
+      return false;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    ++hits_;
+    return true;
+  }
+
+  void insert(const std::string& key, clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (max_entries_ == 0) {
+      return;
+    }
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      it->second->expires = now + ttl_;
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return;
+    }
+    if (entries_.size() == max_entries_) {
+      evict();
+    }
+    entries_.push_front({key, now + ttl_});
+    index_.emplace(key, entries_.begin());
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    index_.clear();
+  }
+
+  std::size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  std::uint64_t hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+  }
+
+  std::uint64_t misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+  }
+
+private:
+  struct entry {
+    std::string key;
+    clock::time_point expires;
+  };
+
+  void evict() {
+    index_.erase(entries_.back().key);
+    entries_.pop_back();
+  }
+
+  mutable std::mutex mutex_;
+  std::size_t max_entries_ = 0;
+  clock::duration ttl_{};
+  std::list<entry> entries_;
+  std::unordered_map<std::string, std::list<entry>::iterator> index_;
+  std::uint64_t hits_ = 0;
+  std::uint64_t misses_ = 0;
+};
+
+} // namespace detail
+} // namespace wintls
+
+#endif // WINTLS_DETAIL_VERIFICATION_CACHE_HPP
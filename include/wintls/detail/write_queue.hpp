@@ -0,0 +1,221 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_DETAIL_WRITE_QUEUE_HPP
+#define WINTLS_DETAIL_WRITE_QUEUE_HPP
+
+#include <wintls/detail/config.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace wintls {
+namespace detail {
+
+// Writes queued on a stream waiting for their data to be encrypted and
+// written to the next layer. The data of several writes is gathered
+// into the same records to write it in as few operations as possible.
+class write_queue {
+public:
+  class operation {
+  public:
+    // The executor the completion handler of the write is invoked on
+    virtual net::any_io_executor executor() const = 0;
+
+    // Invokes the completion handler of the write. Called at most once.
+    virtual void complete(const wintls::error_code& ec, std::size_t size) = 0;
+
+    // Destroys the operation and frees its memory
+    virtual void destroy() = 0;
+
+  protected:
+    ~operation() = default;
+
+    // Sets the data to write which must remain valid until the
+    // operation is destroyed
+    void set_buffers(const net::const_buffer* buffers, std::size_t count) {
+      buffers_ = buffers;
+      count_ = count;
+      size_ = net::buffer_size(buffers_range{buffers, count});
+    }
+
+  private:
+    friend class write_queue;
+
+    struct buffers_range {
+      const net::const_buffer* begin() const {
+        return data;
+      }
+      const net::const_buffer* end() const {
+        return data + count;
+      }
+      const net::const_buffer* data;
+      std::size_t count;
+    };
+
+    const net::const_buffer* buffers_ = nullptr;
+    std::size_t count_ = 0;
+    std::size_t size_ = 0;
+    std::size_t encrypted_ = 0;
+    operation* next_ = nullptr;
+  };
+
+  write_queue() = default;
+  write_queue(const write_queue&) = delete;
+  write_queue& operator=(const write_queue&) = delete;
+
+  ~write_queue() {
+    while (head_ != nullptr) {
+      pop()->destroy();
+    }
+    ::operator delete(writer_memory_);
+  }
+
+  // Takes ownership of the operation
+  void push(operation* op) {
+    if (op->size_ == 0) {
+      operation_ptr ptr{op};
+      ptr->complete({}, 0);
+      return;
+    }
+    if (tail_ != nullptr) {
+      tail_->next_ = op;
+    } else {
+      head_ = op;
+    }
+    tail_ = op;
+  }
+
+  bool empty() const {
+    return head_ == nullptr;
+  }
+
+  bool writing() const {
+    return writing_;
+  }
+
+  void set_writing(bool writing) {
+    writing_ = writing;
+  }
+
+  // Closed once the stream is destroyed, after which the writes still
+  // queued are aborted instead of being written to the next layer
+  bool closed() const {
+    return closed_;
+  }
+
+  void close() {
+    closed_ = true;
+  }
+
+  // The executor of the first write in the queue
+  net::any_io_executor executor() const {
+    return head_->executor();
+  }
+
+  // The data of the queued writes not yet encrypted, up to about
+  // max_size bytes
+  const std::vector<net::const_buffer>& gather(std::size_t max_size) {
+    gathered_.clear();
+    std::size_t size = 0;
+    for (auto op = head_; op != nullptr; op = op->next_) {
+      auto offset = op->encrypted_;
+      for (const auto& buffer : operation::buffers_range{op->buffers_, op->count_}) {
+        if (offset >= buffer.size()) {
+          offset -= buffer.size();
+          continue;
+        }
+        gathered_.push_back(buffer + offset);
+        size += buffer.size() - offset;
+        offset = 0;
+      }
+      if (size >= max_size) {
+        break;
+      }
+    }
+    return gathered_;
+  }
+
+  // Marks size bytes of the gathered data as encrypted
+  void encrypted(std::size_t size) {
+    for (auto op = head_; op != nullptr && size > 0; op = op->next_) {
+      const auto consumed = std::min(size, op->size_ - op->encrypted_);
+      op->encrypted_ += consumed;
+      size -= consumed;
+    }
+  }
+
+  // Completes the writes whose data has been encrypted and written or
+  // all writes if writing failed
+  void written(const wintls::error_code& ec) {
+    while (head_ != nullptr && (ec || head_->encrypted_ == head_->size_)) {
+      operation_ptr op{pop()};
+      op->complete(ec, ec ? 0 : op->size_);
+    }
+  }
+
+  // Memory for the writes to the next layer. As only a single write is
+  // in progress at any time, the same memory is reused for all of them.
+  void* allocate_writer(std::size_t size) {
+    if (writer_memory_in_use_) {
+      return ::operator new(size);
+    }
+    if (size > writer_memory_size_) {
+      ::operator delete(writer_memory_);
+      writer_memory_ = nullptr;
+      writer_memory_size_ = 0;
+      writer_memory_ = ::operator new(size);
+      writer_memory_size_ = size;
+    }
+    writer_memory_in_use_ = true;
+    return writer_memory_;
+  }
+
+  void deallocate_writer(void* pointer) {
+    if (pointer == writer_memory_) {
+      writer_memory_in_use_ = false;
+      return;
+    }
+    ::operator delete(pointer);
+  }
+
+private:
+  struct operation_deleter {
+    void operator()(operation* op) const {
+      op->destroy();
+    }
+  };
+
+  using operation_ptr = std::unique_ptr<operation, operation_deleter>;
+
+  operation* pop() {
+    auto op = head_;
+    head_ = op->next_;
+    if (head_ == nullptr) {
+      tail_ = nullptr;
+    }
+    return op;
+  }
+
+  // Intrusive list of the queued writes, so queueing a write does not
+  // allocate any memory besides the write itself
+  operation* head_ = nullptr;
+  operation* tail_ = nullptr;
+  std::vector<net::const_buffer> gathered_;
+  bool writing_ = false;
+  bool closed_ = false;
+  void* writer_memory_ = nullptr;
+  std::size_t writer_memory_size_ = 0;
+  bool writer_memory_in_use_ = false;
+};
+
+} // namespace detail
+} // namespace wintls
+
+#endif // WINTLS_DETAIL_WRITE_QUEUE_HPP
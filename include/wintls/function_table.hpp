@@ -0,0 +1,49 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_FUNCTION_TABLE_HPP
+#define WINTLS_FUNCTION_TABLE_HPP
+
+#include <wintls/detail/sspi_functions.hpp>
+
+namespace wintls {
+
+/**
+ * @verbatim embed:rst:leading-asterisk
+ * Use a custom SSPI `SecurityFunctionTableA`_ for all streams and contexts.
+ * @endverbatim
+ *
+ * By default the function table returned by `InitSecurityInterfaceA`
+ * is used, ie. the Schannel implementation provided by the operating
+ * system. This function can be used to replace it with a custom
+ * implementation, eg. for testing or profiling the stream without
+ * performing actual cryptographic operations.
+ *
+ * @param table The function table to use or a null pointer to
+ * restore the operating system function table.
+ *
+ * @note Handles obtained from one function table cannot be used
+ * with another, so the function table should only be changed when
+ * no streams or contexts that have been used for handshaking exist.
+ */
+inline void set_sspi_function_table(SecurityFunctionTableA* table) {
+  detail::sspi_functions::custom_function_table().store(table, std::memory_order_release);
+}
+
+/**
+ * @verbatim embed:rst:leading-asterisk
+ * Get the SSPI `SecurityFunctionTableA`_ currently in use.
+ * @endverbatim
+ *
+ * @return The function table set by @ref set_sspi_function_table or
+ * the operating system function table if none has been set.
+ */
+inline SecurityFunctionTableA* sspi_function_table() {
+  return detail::sspi_functions::sspi_function_table();
+}
+
+} // namespace wintls
+
+#endif // WINTLS_FUNCTION_TABLE_HPP
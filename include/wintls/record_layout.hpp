@@ -0,0 +1,33 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_RECORD_LAYOUT_HPP
+#define WINTLS_RECORD_LAYOUT_HPP
+
+#include <cstddef>
+
+namespace wintls {
+
+/** Layout of a TLS record encrypted in place.
+ *
+ * A buffer passed to @ref stream::write_in_place holds a single TLS
+ * record with the data to encrypt placed `header_size` bytes from
+ * the start of the buffer followed by at least `trailer_size` bytes
+ * of space for the record trailer.
+ */
+struct record_layout {
+  /// Space reserved before the data for the record header.
+  std::size_t header_size = 0;
+
+  /// Maximum size of the data of a single record.
+  std::size_t max_data_size = 0;
+
+  /// Space reserved after the data for the record trailer.
+  std::size_t trailer_size = 0;
+};
+
+} // namespace wintls
+
+#endif // WINTLS_RECORD_LAYOUT_HPP
@@ -0,0 +1,46 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_RECORD_SIZING_HPP
+#define WINTLS_RECORD_SIZING_HPP
+
+#include <chrono>
+#include <cstddef>
+
+namespace wintls {
+
+/** Policy for sizing the TLS records written by a @ref stream.
+ *
+ * The peer can only decrypt a record once all of it has been
+ * received. Records holding the maximum amount of data spread over
+ * several TCP segments, delaying the first data available to the
+ * peer, while small records waste bandwidth and CPU time on their
+ * headers and trailers.
+ *
+ * With dynamic record sizing, the first data written after the
+ * handshake or after the stream has been idle is sent in small
+ * records fitting in a single TCP segment. Once enough data has been
+ * written, records holding the maximum amount of data are used.
+ *
+ * @see stream::set_record_sizing
+ */
+struct record_sizing {
+  /// Maximum size of the data of the small records. The default
+  /// makes a record fit in a single TCP segment on a typical path
+  /// with an MTU of 1500 bytes.
+  std::size_t small_record_size = 1369;
+
+  /// Bytes to write in small records before using full size records.
+  /// Zero disables dynamic record sizing.
+  std::size_t ramp_up_size = 0x10000;
+
+  /// Time without any writes after which small records are used
+  /// again. Zero never uses small records again.
+  std::chrono::milliseconds idle_timeout{1000};
+};
+
+} // namespace wintls
+
+#endif // WINTLS_RECORD_SIZING_HPP
@@ -10,23 +10,33 @@
 
 #include <wintls/error.hpp>
 #include <wintls/handshake_type.hpp>
+#include <wintls/record_layout.hpp>
+#include <wintls/record_sizing.hpp>
+#include <wintls/stream_statistics.hpp>
 
 #include <wintls/detail/assert.hpp>
+#include <wintls/detail/async_flush.hpp>
 #include <wintls/detail/async_handshake.hpp>
 #include <wintls/detail/async_read.hpp>
 #include <wintls/detail/async_shutdown.hpp>
+#include <wintls/detail/async_wait.hpp>
 #include <wintls/detail/async_write.hpp>
+#include <wintls/detail/async_write_queued.hpp>
 #include <wintls/detail/sspi_stream.hpp>
 
 #ifdef WINTLS_USE_STANDALONE_ASIO
+#include <asio/async_result.hpp>
 #include <asio/compose.hpp>
 #include <asio/io_context.hpp>
 #else // WINTLS_USE_STANDALONE_ASIO
+#include <boost/asio/async_result.hpp>
 #include <boost/asio/compose.hpp>
 #include <boost/asio/io_context.hpp>
 #endif // !WINTLS_USE_STANDALONE_ASIO
 
+#include <cstdint>
 #include <memory>
+#include <mutex>
 
 namespace wintls {
 
@@ -40,6 +50,13 @@ namespace wintls {
  * operations, the type must support the <em>SyncStream</em> concept.
  * For asynchronous operations, the type must support the
  * <em>AsyncStream</em> concept.
+ *
+ * The stream supports full duplex operation. A single read operation
+ * and a single write operation, or any number of writes queued with
+ * @ref async_write_queued, may be in progress at the same time.
+ * Asynchronous operations must all be performed within the same
+ * implicit or explicit strand. Synchronous reads and writes may be
+ * performed from two different threads at the same time.
  */
 template<class NextLayer>
 class stream {
@@ -62,7 +79,7 @@ public:
   template <class Arg>
   stream(Arg&& arg, context& ctx)
     : next_layer_(std::forward<Arg>(arg))
-    , sspi_stream_(std::make_unique<detail::sspi_stream>(ctx)) {
+    , sspi_stream_(ctx) {
   }
 
   /** Get the executor associated with the object.
@@ -115,6 +132,36 @@ public:
     sspi_stream_->handshake.set_server_hostname(hostname);
   }
 
+  /** Set the port of the server
+   *
+   * Sets the port the client is connecting to. Together with the
+   * hostname set with @ref set_server_hostname, it identifies the
+   * server TLS sessions are resumed with when the context keeps
+   * sessions per server.
+   *
+   * Only used when handshake is performed as @ref
+   * handshake_type::client
+   *
+   * @param port The port of the server
+   *
+   * @see context::set_session_cache_size
+   */
+  void set_server_port(std::uint16_t port) {
+    sspi_stream_->handshake.set_server_port(port);
+  }
+
+  /** Check whether the handshake resumed a previous session
+   *
+   * A resumed session skips most of the TLS handshake, saving CPU
+   * time and round trips.
+   *
+   * @return True if the last completed handshake resumed a previous
+   * TLS session.
+   */
+  bool session_resumed() const {
+    return sspi_stream_->handshake.session_resumed();
+  }
+
   /** Set revocation checking
    *
    *  Enable revocation checking for remote certificates.
@@ -128,6 +175,160 @@ public:
     sspi_stream_->handshake.set_certificate_revocation_check(check);
   }
 
+  /** Set the maximum number of TLS records per write operation
+   *
+   * By default each write operation encrypts at most a single TLS
+   * record, ie. 16 KiB of data. Allowing more records per write
+   * makes writing large amounts of data require fewer write
+   * operations on the next layer, at the cost of a larger buffer for
+   * encrypted data.
+   *
+   * The records are written to the next layer as a single
+   * contiguous buffer. The data of a buffer sequence is gathered
+   * into the records, so writing a sequence of many small buffers,
+   * like the output of a serializer, also requires only a single
+   * write operation on the next layer.
+   *
+   * @param count The maximum number of records encrypted by each
+   * write operation. Values less than one are treated as one.
+   */
+  void set_max_records_per_write(std::size_t count) {
+    sspi_stream_->encrypt.set_max_records(count);
+  }
+
+  /** Enable dynamic TLS record sizing
+   *
+   * By default each record holds as much data as possible. The peer
+   * cannot decrypt any of the data of a record before all of it has
+   * been received, which delays the first data of for example an
+   * HTTP response.
+   *
+   * With dynamic record sizing, the data written after the handshake
+   * or after the stream has been idle is sent in small records until
+   * `ramp_up_size` bytes have been written, after which full size
+   * records are used again.
+   *
+   * @param sizing The @ref record_sizing policy to use. A
+   * `ramp_up_size` of zero disables dynamic record sizing.
+   *
+   * @see stream_statistics::small_records_encrypted
+   */
+  void set_record_sizing(const record_sizing& sizing) {
+    sspi_stream_->encrypt.set_record_sizing(sizing);
+  }
+
+  /** Enable corking of writes
+   *
+   * Every write operation normally encrypts the data into a TLS
+   * record of its own and writes it to the next layer. Protocols
+   * performing many small writes thereby pay for encrypting and
+   * sending the header and trailer of a record for each of them.
+   *
+   * While corked, the data of @ref write_some and @ref
+   * async_write_some is instead copied into a single record which is
+   * only encrypted and written once it holds the maximum amount of
+   * data of a record or when @ref flush or @ref async_flush is
+   * called. Writes not filling the record complete without writing
+   * anything to the next layer.
+   *
+   * Disabling corking does not write any buffered data by itself.
+   * Data buffered while corked is always written ahead of the data
+   * of any later write, including writes while no longer corked,
+   * writes of data encrypted in place and with @ref
+   * async_write_queued, which are never corked. It is also written
+   * before shutting down the stream.
+   *
+   * @param cork Whether to cork writes.
+   */
+  void set_cork(bool cork) {
+    sspi_stream_->encrypt.set_corked(cork);
+  }
+
+  /** Release buffers while the stream is idle
+   *
+   * A stream keeps the buffers used for receiving and sending TLS
+   * records, each large enough to hold a full record, for as long as
+   * the stream exists. For servers holding many mostly idle
+   * connections, like long polling or push notification services,
+   * these buffers make up most of the memory used per connection.
+   *
+   * When enabled, the stream returns these buffers to the @ref
+   * buffer_pool of the context, or frees them if the context has no
+   * pool, whenever all data received has been decrypted and returned
+   * and when the encrypted data has been written. A read waiting for
+   * data from the next layer then reads only the header of the next
+   * TLS record into storage inside the stream and reacquires a
+   * buffer once data arrives.
+   *
+   * This costs a buffer allocation for every read and write
+   * operation and an additional read operation on the next layer for
+   * each read started while no data is buffered.
+   *
+   * @param release Whether to release buffers while idle.
+   */
+  void set_release_idle_buffers(bool release) {
+    sspi_stream_->encrypt.set_release_idle_buffers(release);
+    sspi_stream_->decrypt.set_release_idle_buffers(release);
+  }
+
+  /** Set the executor used for verifying the remote certificate
+   *
+   * Verifying the certificate chain of the remote peer may block
+   * while fetching revocation information from the network when
+   * revocation checking is enabled. By default this is done on the
+   * executor of the stream, stalling all other operations on it.
+   *
+   * When an executor is set, asynchronous handshakes verify the
+   * remote certificate on that executor, typically a thread pool,
+   * and continue on the executor of the stream afterwards.
+   * Synchronous handshakes are not affected.
+   *
+   * @param executor The executor to verify certificates on or a
+   * default constructed executor to verify them on the executor of
+   * the stream.
+   */
+  void set_verification_executor(const net::any_io_executor& executor) {
+    verification_executor_ = executor;
+  }
+
+  /** Enable immediate completion of reads
+   *
+   * Reads which can be completed from data already received, like
+   * the remaining data of a record larger than the buffers of the
+   * previous read or a complete record received along with the
+   * previous one, never start an asynchronous operation. By default
+   * the handler of such a read is posted to its associated executor.
+   *
+   * With immediate completion enabled the handler is dispatched
+   * through its associated immediate executor instead, as returned
+   * by `net::get_associated_immediate_executor` with the executor of
+   * the next layer. Binding an immediate executor to the handler with
+   * `net::bind_immediate_executor` allows it to be invoked before
+   * @ref async_read_some returns, avoiding a round trip through the
+   * executor for protocols performing many small reads, while the
+   * bound executor decides how deep such completions may nest.
+   *
+   * @param immediate Whether reads may complete immediately.
+   */
+  void set_immediate_completion(bool immediate) {
+    immediate_completion_ = immediate;
+  }
+
+  /** Get statistics about the stream.
+   *
+   * Returns a snapshot of the counters collected for the operations
+   * performed on the stream so far.
+   *
+   * The statistics are only collected if `WINTLS_ENABLE_STATISTICS`
+   * is defined before including any wintls headers. Otherwise all
+   * values are zero.
+   *
+   * @return The @ref stream_statistics of the stream.
+   */
+  stream_statistics statistics() const {
+    return sspi_stream_->stats.snapshot();
+  }
+
   /** Perform TLS handshaking.
    *
    * This function is used to perform TLS handshaking on the
@@ -175,6 +376,7 @@ private:
         case detail::sspi_handshake::state::renegotiate_data_available:
           auto& buffer = sspi_stream_->handshake.get_renegotiate_data_buffer();
           sspi_stream_->decrypt.load_renegotiate_extra_data(buffer);
+          sspi_stream_->handshake.free_input_buffer();
           return;
       }
     }
@@ -226,7 +428,7 @@ public:
   template <class CompletionToken>
   auto async_handshake(handshake_type type, CompletionToken&& handler) {
     return net::async_compose<CompletionToken, void(wintls::error_code)>(
-        detail::async_handshake<next_layer_type>{next_layer_, sspi_stream_->handshake, type}, handler);
+        detail::async_handshake<next_layer_type>{next_layer_, sspi_stream_->handshake, type, verification_executor_}, handler);
   }
 
   /** Read some data from the stream.
@@ -255,11 +457,13 @@ public:
       if (state == detail::sspi_decrypt::state::data_needed) {
         size_read = next_layer_.read_some(sspi_stream_->decrypt.input_buffer, ec);
         if (ec) {
+          sspi_stream_->decrypt.read_failed();
           return 0;
         }
         sspi_stream_->decrypt.size_read(size_read);
       } else if (state == detail::sspi_decrypt::state::renegotiate_handshake) {
         auto& buffer = sspi_stream_->decrypt.get_renegotiate_data_buffer();
+        std::lock_guard<std::mutex> lock(sspi_stream_->write_mutex);
         sspi_stream_->handshake.load_renegotiate_extra_data(buffer);
         handshake_second_stage(ec);
         if (ec) {
@@ -328,11 +532,108 @@ public:
    * requested number of bytes. Consider using the `net::async_read`
    * function if you need to ensure that the requested amount of data
    * is read before the asynchronous operation completes.
+   *
+   * @note A read completed from data already received does not start
+   * an asynchronous operation. Its handler is posted to its
+   * associated executor or, with @ref set_immediate_completion,
+   * dispatched through its associated immediate executor, in which
+   * case it may be invoked from within this function.
    */
   template <class MutableBufferSequence, class CompletionToken>
   auto async_read_some(const MutableBufferSequence& buffers, CompletionToken&& handler) {
-    return net::async_compose<CompletionToken, void(wintls::error_code, std::size_t)>(
-        detail::async_read<next_layer_type, MutableBufferSequence>{next_layer_, buffers, sspi_stream_->decrypt}, handler);
+    return net::async_initiate<CompletionToken, void(wintls::error_code, std::size_t)>(
+        detail::initiate_async_read<next_layer_type>{next_layer_, sspi_stream_->decrypt, immediate_completion_}, handler, buffers);
+  }
+
+  /** Wait for the stream to be ready to read, write or to have
+   * pending error conditions.
+   *
+   * This function is used to perform a blocking wait for the stream
+   * to enter a ready state. A wait for the stream to become readable
+   * returns immediately if a read can be completed from the data
+   * already received, otherwise it waits on the next layer, like all
+   * other waits.
+   *
+   * As the data received by the next layer may not be a complete TLS
+   * record, or a record holding application data, a read started
+   * after waiting may still have to wait for more data.
+   *
+   * @param type Specifies the desired wait state.
+   * @param ec Set to indicate what error occurred, if any.
+   */
+  void wait(net::socket_base::wait_type type, wintls::error_code& ec) {
+    if (type == net::socket_base::wait_read) {
+      if (sspi_stream_->decrypt.data_buffered()) {
+        ec = {};
+        return;
+      }
+      sspi_stream_->decrypt.release_buffers_if_idle();
+    }
+    next_layer_.wait(type, ec);
+  }
+
+  /** Wait for the stream to be ready to read, write or to have
+   * pending error conditions.
+   *
+   * This function is used to perform a blocking wait for the stream
+   * to enter a ready state. A wait for the stream to become readable
+   * returns immediately if a read can be completed from the data
+   * already received, otherwise it waits on the next layer, like all
+   * other waits.
+   *
+   * As the data received by the next layer may not be a complete TLS
+   * record, or a record holding application data, a read started
+   * after waiting may still have to wait for more data.
+   *
+   * @param type Specifies the desired wait state.
+   *
+   * @throws wintls::system_error Thrown on failure.
+   */
+  void wait(net::socket_base::wait_type type) {
+    wintls::error_code ec{};
+    wait(type, ec);
+    if (ec) {
+      detail::throw_error(ec);
+    }
+  }
+
+  /** Start an asynchronous wait for the stream to be ready to read,
+   * write or to have pending error conditions.
+   *
+   * This function is used to asynchronously wait for the stream to
+   * enter a ready state without providing any buffers, allowing
+   * servers holding many connections to only commit memory for
+   * reading from connections with data available. The function call
+   * always returns immediately.
+   *
+   * A wait for the stream to become readable completes without
+   * waiting on the next layer if a read can be completed from the
+   * data already received, like decrypted data not yet read or a
+   * complete TLS record. The handler is then posted to its
+   * associated executor or, with @ref set_immediate_completion,
+   * dispatched through its associated immediate executor. Otherwise, and for all other waits, the wait
+   * is performed by the `async_wait` function of the next layer.
+   * When releasing buffers while idle with @ref
+   * set_release_idle_buffers, the stream holds no buffers while
+   * waiting to become readable.
+   *
+   * As the data received by the next layer may not be a complete TLS
+   * record, or a record holding application data, a read started
+   * after waiting may still have to wait for more data.
+   *
+   * @param type Specifies the desired wait state.
+   * @param handler The handler to be called when the wait operation
+   * completes. Copies will be made of the handler as required. The
+   * equivalent function signature of the handler must be:
+   * @code
+   * void handler(
+   *     const wintls::error_code& error // Result of operation.
+   * ); @endcode
+   */
+  template <class CompletionToken>
+  auto async_wait(net::socket_base::wait_type type, CompletionToken&& handler) {
+    return net::async_initiate<CompletionToken, void(wintls::error_code)>(
+        detail::initiate_async_wait<next_layer_type>{next_layer_, sspi_stream_->decrypt, immediate_completion_}, handler, type);
   }
 
   /** Write some data to the stream.
@@ -353,12 +654,13 @@ public:
    */
   template <class ConstBufferSequence>
   std::size_t write_some(const ConstBufferSequence& buffers, wintls::error_code& ec) {
-    std::size_t bytes_consumed = sspi_stream_->encrypt(buffers, ec);
+    std::lock_guard<std::mutex> lock(sspi_stream_->write_mutex);
+    std::size_t bytes_consumed = sspi_stream_->encrypt.write(buffers, ec);
     if (ec) {
       return 0;
     }
 
-    net::write(next_layer_, sspi_stream_->encrypt.buffers, ec);
+    write_record(ec);
     if (ec) {
       return 0;
     }
@@ -422,7 +724,230 @@ public:
   template <class ConstBufferSequence, class CompletionToken>
   auto async_write_some(const ConstBufferSequence& buffers, CompletionToken&& handler) {
     return net::async_compose<CompletionToken, void(wintls::error_code, std::size_t)>(
-        detail::async_write<next_layer_type, ConstBufferSequence>{next_layer_, buffers, sspi_stream_->encrypt}, handler);
+        detail::async_write<next_layer_type, ConstBufferSequence>{next_layer_, buffers, sspi_stream_->encrypt},
+        handler,
+        next_layer_);
+  }
+
+  /** Write the data buffered while corked to the stream.
+   *
+   * This function encrypts the data buffered by writes while corked
+   * with @ref set_cork and writes it to the stream. The function call
+   * will block until the data has been written or an error occurs.
+   * Does nothing if no data is buffered.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   */
+  void flush(wintls::error_code& ec) {
+    std::lock_guard<std::mutex> lock(sspi_stream_->write_mutex);
+    sspi_stream_->encrypt.flush(ec);
+    if (ec) {
+      return;
+    }
+    write_record(ec);
+  }
+
+  /** Write the data buffered while corked to the stream.
+   *
+   * This function encrypts the data buffered by writes while corked
+   * with @ref set_cork and writes it to the stream. The function call
+   * will block until the data has been written or an error occurs.
+   * Does nothing if no data is buffered.
+   *
+   * @throws wintls::system_error Thrown on failure.
+   */
+  void flush() {
+    wintls::error_code ec{};
+    flush(ec);
+    if (ec) {
+      detail::throw_error(ec);
+    }
+  }
+
+  /** Start an asynchronous write of the data buffered while corked.
+   *
+   * This function is used to asynchronously encrypt the data
+   * buffered by writes while corked with @ref set_cork and write it
+   * to the stream. The function call always returns immediately.
+   *
+   * Like other writes, it must not be performed while another write
+   * is in progress. Applications wanting buffered data to be written
+   * after some time without further writes can flush it from a timer.
+   *
+   * @param handler The handler to be called when the data has been
+   * written. Copies will be made of the handler as required. The
+   * equivalent function signature of the handler must be:
+   * @code
+   * void handler(
+   *     const wintls::error_code& error // Result of operation.
+   * );
+   * @endcode
+   */
+  template <class CompletionToken>
+  auto async_flush(CompletionToken&& handler) {
+    return net::async_compose<CompletionToken, void(wintls::error_code)>(
+        detail::async_flush<next_layer_type>{next_layer_, sspi_stream_->encrypt}, handler, next_layer_);
+  }
+
+  /** Queue data to be written to the stream.
+   *
+   * This function is used to asynchronously write all of the data to
+   * the stream. Unlike @ref async_write_some, any number of writes
+   * may be queued at the same time, without waiting for the previous
+   * ones to complete. The data is written in the order the writes
+   * are queued and the data of writes queued while another write is
+   * in progress is encrypted into as few TLS records and written with
+   * as few write operations on the next layer as possible. The
+   * function call always returns immediately.
+   *
+   * @param buffers The data to be written to the stream. Although the
+   * buffers object may be copied as necessary, ownership of the
+   * underlying buffers is retained by the caller, which must
+   * guarantee that they remain valid until the handler is called.
+   * @param handler The handler to be called when all of the data has
+   * been written. Copies will be made of the handler as required. The
+   * equivalent function signature of the handler must be:
+   * @code
+   * void handler(
+   *     const wintls::error_code& error, // Result of operation.
+   *     std::size_t bytes_transferred    // Number of bytes written.
+   * );
+   * @endcode
+   *
+   * @note Queued writes must not be mixed with other write operations
+   * while any of them are in progress. Like all other asynchronous
+   * operations on the stream, they must be performed within the same
+   * implicit or explicit strand.
+   *
+   * @note If the stream is destroyed while writes are queued, the
+   * writes not yet written to the next layer complete with
+   * net::error::operation_aborted.
+   */
+  template <class ConstBufferSequence, class CompletionToken>
+  auto async_write_queued(const ConstBufferSequence& buffers, CompletionToken&& handler) {
+    return net::async_compose<CompletionToken, void(wintls::error_code, std::size_t)>(
+        detail::async_write_queued<next_layer_type, ConstBufferSequence>{next_layer_, buffers, sspi_stream_.get()},
+        handler,
+        next_layer_);
+  }
+
+  /** Get the layout of records encrypted in place.
+   *
+   * This function returns the space required around the data of a
+   * TLS record for encrypting it in place with @ref write_in_place.
+   * The layout is only available once the handshake has completed.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   *
+   * @returns The @ref record_layout of the stream.
+   */
+  wintls::record_layout query_record_layout(wintls::error_code& ec) {
+    return sspi_stream_->encrypt.layout(ec);
+  }
+
+  /** Get the layout of records encrypted in place.
+   *
+   * This function returns the space required around the data of a
+   * TLS record for encrypting it in place with @ref write_in_place.
+   * The layout is only available once the handshake has completed.
+   *
+   * @returns The @ref record_layout of the stream.
+   *
+   * @throws wintls::system_error Thrown on failure.
+   */
+  wintls::record_layout query_record_layout() {
+    wintls::error_code ec{};
+    auto layout = query_record_layout(ec);
+    if (ec) {
+      detail::throw_error(ec);
+    }
+    return layout;
+  }
+
+  /** Encrypt data in place and write it to the stream.
+   *
+   * This function encrypts a single TLS record in the memory of the
+   * caller, avoiding copying the data to an internal buffer, and
+   * writes it to the next layer. The function call will block until
+   * the whole record has been written or an error occurs.
+   *
+   * The data must be placed `header_size` bytes from the start of
+   * the buffer and be followed by at least `trailer_size` bytes as
+   * described by @ref query_record_layout.
+   *
+   * @param buffer The buffer holding the record. The contents of the
+   * buffer are overwritten by the encrypted record.
+   * @param size The size of the data to encrypt. Must not exceed
+   * `max_data_size`.
+   * @param ec Set to indicate what error occurred, if any.
+   *
+   * @returns The number of bytes of data written.
+   */
+  std::size_t write_in_place(const net::mutable_buffer& buffer, std::size_t size, wintls::error_code& ec) {
+    return write_some(detail::in_place_record{buffer, size}, ec);
+  }
+
+  /** Encrypt data in place and write it to the stream.
+   *
+   * This function encrypts a single TLS record in the memory of the
+   * caller, avoiding copying the data to an internal buffer, and
+   * writes it to the next layer. The function call will block until
+   * the whole record has been written or an error occurs.
+   *
+   * The data must be placed `header_size` bytes from the start of
+   * the buffer and be followed by at least `trailer_size` bytes as
+   * described by @ref query_record_layout.
+   *
+   * @param buffer The buffer holding the record. The contents of the
+   * buffer are overwritten by the encrypted record.
+   * @param size The size of the data to encrypt. Must not exceed
+   * `max_data_size`.
+   *
+   * @returns The number of bytes of data written.
+   *
+   * @throws wintls::system_error Thrown on failure.
+   */
+  std::size_t write_in_place(const net::mutable_buffer& buffer, std::size_t size) {
+    wintls::error_code ec{};
+    auto wrote = write_in_place(buffer, size, ec);
+    if (ec) {
+      detail::throw_error(ec);
+    }
+    return wrote;
+  }
+
+  /** Start an asynchronous write of data encrypted in place.
+   *
+   * This function is used to asynchronously encrypt a single TLS
+   * record in the memory of the caller and write it to the next
+   * layer. The function call always returns immediately.
+   *
+   * The data must be placed `header_size` bytes from the start of
+   * the buffer and be followed by at least `trailer_size` bytes as
+   * described by @ref query_record_layout.
+   *
+   * @param buffer The buffer holding the record. The contents of the
+   * buffer are overwritten by the encrypted record. Ownership of the
+   * buffer is retained by the caller, which must guarantee that it
+   * remains valid until the handler is called.
+   * @param size The size of the data to encrypt. Must not exceed
+   * `max_data_size`.
+   * @param handler The handler to be called when the write operation
+   * completes.  Copies will be made of the handler as required. The
+   * equivalent function signature of the handler must be:
+   * @code
+   * void handler(
+   *     const wintls::error_code& error, // Result of operation.
+   *     std::size_t bytes_transferred    // Number of bytes of data written.
+   * );
+   * @endcode
+   */
+  template <class CompletionToken>
+  auto async_write_in_place(const net::mutable_buffer& buffer, std::size_t size, CompletionToken&& handler) {
+    return net::async_compose<CompletionToken, void(wintls::error_code, std::size_t)>(
+        detail::async_write<next_layer_type, detail::in_place_record>{next_layer_, detail::in_place_record{buffer, size}, sspi_stream_->encrypt},
+        handler,
+        next_layer_);
   }
 
   /** Shut down TLS on the stream.
@@ -434,6 +959,11 @@ public:
    * @param ec Set to indicate what error occurred, if any.
    */
   void shutdown(wintls::error_code& ec) {
+    // Data still corked is written before shutting down
+    flush(ec);
+    if (ec) {
+      return;
+    }
     ec = sspi_stream_->shutdown();
     if (ec) {
       return;
@@ -477,12 +1007,25 @@ public:
   template <class CompletionToken>
   auto async_shutdown(CompletionToken&& handler) {
     return net::async_compose<CompletionToken, void(wintls::error_code)>(
-        detail::async_shutdown<next_layer_type>{next_layer_, sspi_stream_->shutdown}, handler);
+        detail::async_shutdown<next_layer_type>{next_layer_, sspi_stream_->encrypt, sspi_stream_->shutdown}, handler, next_layer_);
   }
 
 private:
+  // Writes the records encrypted by the last write, if any
+  void write_record(wintls::error_code& ec) {
+    if (net::buffer_size(sspi_stream_->encrypt.record()) == 0) {
+      return;
+    }
+    std::size_t size_written = net::write(next_layer_, sspi_stream_->encrypt.record(), ec);
+    if (!ec) {
+      sspi_stream_->encrypt.size_written(size_written);
+    }
+  }
+
   NextLayer next_layer_;
-  std::unique_ptr<detail::sspi_stream> sspi_stream_;
+  detail::sspi_stream_owner sspi_stream_;
+  net::any_io_executor verification_executor_;
+  bool immediate_completion_ = false;
 };
 
 } // namespace wintls
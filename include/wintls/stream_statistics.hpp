@@ -0,0 +1,79 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WINTLS_STREAM_STATISTICS_HPP
+#define WINTLS_STREAM_STATISTICS_HPP
+
+#include <chrono>
+#include <cstdint>
+
+namespace wintls {
+
+/** Statistics collected by a @ref stream.
+ *
+ * The statistics are only collected if `WINTLS_ENABLE_STATISTICS` is
+ * defined before including any wintls headers. Otherwise all values
+ * are always zero and the counters are never updated. Code compiled
+ * with and without the macro may be linked together.
+ */
+struct stream_statistics {
+  /// Decrypted bytes returned by read operations.
+  std::uint64_t plaintext_bytes_read = 0;
+
+  /// Bytes encrypted by write operations.
+  std::uint64_t plaintext_bytes_written = 0;
+
+  /// Plaintext bytes copied between the buffers of operations and
+  /// the buffers of the stream, or moved within them.
+  std::uint64_t plaintext_bytes_copied = 0;
+
+  /// Bytes read from the next layer, including handshake messages.
+  std::uint64_t ciphertext_bytes_read = 0;
+
+  /// Bytes written to the next layer, including handshake messages.
+  std::uint64_t ciphertext_bytes_written = 0;
+
+  /// TLS records encrypted.
+  std::uint64_t records_encrypted = 0;
+
+  /// TLS records decrypted.
+  std::uint64_t records_decrypted = 0;
+
+  /// TLS records encrypted while ramping up with dynamic record sizing.
+  std::uint64_t small_records_encrypted = 0;
+
+  /// Times dynamic record sizing went back to small records after
+  /// the stream had been idle.
+  std::uint64_t record_sizing_resets = 0;
+
+  /// Read operations on the next layer.
+  std::uint64_t next_layer_reads = 0;
+
+  /// Write operations on the next layer.
+  std::uint64_t next_layer_writes = 0;
+
+  /// Times decryption had to wait for the rest of a partially received record.
+  std::uint64_t incomplete_records = 0;
+
+  /// Times decrypted data did not fit in the buffers of a read
+  /// operation and was kept for the next read.
+  std::uint64_t decrypted_data_spills = 0;
+
+  /// Handshakes completed.
+  std::uint64_t handshakes = 0;
+
+  /// Handshakes which resumed a previous TLS session.
+  std::uint64_t sessions_resumed = 0;
+
+  /// Times the handshake waited for a reply after sending a message.
+  std::uint64_t handshake_round_trips = 0;
+
+  /// Wall clock time of the last completed handshake.
+  std::chrono::nanoseconds handshake_time{0};
+};
+
+} // namespace wintls
+
+#endif // WINTLS_STREAM_STATISTICS_HPP
@@ -0,0 +1,190 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls/buffer_pool.hpp>
+#include <wintls/detail/stream_buffer.hpp>
+#include <wintls/stream.hpp>
+
+#include <array>
+#include <cstring>
+#include <memory>
+#include <string>
+
+using wintls::test::generate_data;
+using wintls::test::loopback_fixture;
+
+TEST_CASE("buffer pool") {
+  wintls::buffer_pool pool(2);
+  CHECK(pool.free_buffers() == 0);
+
+  SECTION("recycles buffers") {
+    auto first = pool.allocate(0x100);
+    pool.deallocate(first, 0x100);
+    CHECK(pool.free_buffers() == 1);
+
+    auto second = pool.allocate(0x4000);
+    CHECK(second == first);
+    CHECK(pool.free_buffers() == 0);
+    pool.deallocate(second, 0x4000);
+  }
+
+  SECTION("size classes") {
+    CHECK(wintls::buffer_pool::capacity(1) >= 0x4000 + 0x800 + 5);
+    CHECK(wintls::buffer_pool::capacity(0x4000) == wintls::buffer_pool::capacity(1));
+    CHECK(wintls::buffer_pool::capacity(0x10000) == 0x10000);
+    CHECK(wintls::buffer_pool::capacity(0x10001) == 0x10001);
+
+    auto record = pool.allocate(0x100);
+    auto handshake = pool.allocate(0x10000);
+    pool.deallocate(handshake, 0x10000);
+    CHECK(pool.allocate(0x100) != handshake);
+    pool.deallocate(record, 0x100);
+  }
+
+  SECTION("bypasses pool for large buffers") {
+    auto large = pool.allocate(0x20000);
+    pool.deallocate(large, 0x20000);
+    CHECK(pool.free_buffers() == 0);
+  }
+
+  SECTION("limits free buffers") {
+    char* buffers[] = {pool.allocate(1), pool.allocate(1), pool.allocate(1)};
+    for (auto buffer : buffers) {
+      pool.deallocate(buffer, 1);
+    }
+    CHECK(pool.free_buffers() == 2);
+    pool.shrink();
+    CHECK(pool.free_buffers() == 0);
+  }
+}
+
+TEST_CASE("stream buffer") {
+  auto pool = std::make_shared<wintls::buffer_pool>();
+  const std::string data{"abcdef"};
+
+  SECTION("heap") {
+    wintls::detail::stream_buffer buffer;
+    CHECK(buffer.empty());
+    buffer.resize(data.size());
+    std::memcpy(buffer.data(), data.data(), data.size());
+    buffer.resize(0x100);
+    CHECK(buffer.size() == 0x100);
+    CHECK(std::string(buffer.data(), data.size()) == data);
+    buffer.release();
+    CHECK(buffer.empty());
+  }
+
+  SECTION("pool") {
+    {
+      wintls::detail::stream_buffer buffer(pool);
+      buffer.resize(data.size());
+      std::memcpy(buffer.data(), data.data(), data.size());
+      buffer.resize(0x10000);
+      CHECK(std::string(buffer.data(), data.size()) == data);
+      CHECK(pool->free_buffers() == 1);
+    }
+    CHECK(pool->free_buffers() == 2);
+  }
+}
+
+TEST_CASE_METHOD(loopback_fixture, "stream buffer pool") {
+  auto pool = std::make_shared<wintls::buffer_pool>();
+  client_ctx.use_buffer_pool(pool);
+  server_ctx.use_buffer_pool(pool);
+
+  const std::string test_data = generate_data(0x10000);
+
+  auto echo = [&]() {
+    wintls::stream<test_stream> client(io_context, client_ctx);
+    wintls::stream<test_stream> server(io_context, server_ctx);
+    connect(client, server);
+
+    std::string received(test_data.size(), '\0');
+    net::async_write(client, net::buffer(test_data), [](const error_code& ec, std::size_t) {
+      REQUIRE_FALSE(ec);
+    });
+    net::async_read(server, net::buffer(received), [](const error_code& ec, std::size_t) {
+      REQUIRE_FALSE(ec);
+    });
+    io_context.run();
+    io_context.restart();
+    CHECK(received == test_data);
+  };
+
+  echo();
+  const auto free_buffers = pool->free_buffers();
+  CHECK(free_buffers > 0);
+
+  // The buffers of the first connections are reused by the next ones
+  echo();
+  CHECK(pool->free_buffers() == free_buffers);
+}
+
+TEST_CASE_METHOD(loopback_fixture, "stream buffer pool idle buffers") {
+  auto pool = std::make_shared<wintls::buffer_pool>();
+  client_ctx.use_buffer_pool(pool);
+  server_ctx.use_buffer_pool(pool);
+
+  const bool release = GENERATE(false, true);
+  const std::string test_data = generate_data(0x300);
+
+  std::size_t free_buffers = 0;
+  {
+    wintls::stream<test_stream> client(io_context, client_ctx);
+    wintls::stream<test_stream> server(io_context, server_ctx);
+    connect(client, server);
+    client.set_release_idle_buffers(release);
+    server.set_release_idle_buffers(release);
+
+    // Read smaller than a record to have the data decrypted in the
+    // buffers of the stream, first while the data is already available
+    // and then while waiting for it
+    for (int i = 0; i < 2; ++i) {
+      std::string received(test_data.size(), '\0');
+      bool completed = false;
+      if (i == 0) {
+        net::write(client, net::buffer(test_data));
+      }
+      net::async_read(server, net::buffer(received), [&completed](const error_code& ec, std::size_t) {
+        REQUIRE_FALSE(ec);
+        completed = true;
+      });
+      io_context.poll();
+      io_context.restart();
+      if (i == 1) {
+        REQUIRE_FALSE(completed);
+        net::write(client, net::buffer(test_data));
+      }
+      io_context.run();
+      io_context.restart();
+      REQUIRE(completed);
+      CHECK(received == test_data);
+    }
+
+    // Wait for data on the idle stream until the connection is closed
+    std::array<char, 0x100> buffer;
+    error_code read_ec{};
+    server.async_read_some(net::buffer(buffer), [&read_ec](const error_code& ec, std::size_t) {
+      read_ec = ec;
+    });
+    io_context.poll();
+    io_context.restart();
+    free_buffers = pool->free_buffers();
+    server.next_layer().close_remote();
+    io_context.run();
+    CHECK(read_ec == net::error::eof);
+  }
+
+  // Destroying the streams returns the buffers still held by them
+  const auto buffers_held = pool->free_buffers() - free_buffers;
+  if (release) {
+    CHECK(buffers_held == 0);
+  } else {
+    CHECK(buffers_held > 0);
+  }
+}
@@ -0,0 +1,129 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls.hpp>
+
+#include <algorithm>
+#include <string>
+
+using wintls::test::generate_data;
+using wintls::test::loopback_connection;
+using wintls::test::loopback_provider;
+
+TEST_CASE_METHOD(loopback_connection, "cork") {
+  auto test_data_size = GENERATE(0x100, 0x4000, 0x4000 + 1, 0x10000 + 1, 0x100000);
+  const std::string test_data = generate_data(static_cast<std::size_t>(test_data_size));
+
+  // Send the data as small messages, alternating between sync and
+  // async writes, which are only written once a record is full
+  client.set_cork(true);
+  const std::size_t message_size = 200;
+  for (std::size_t offset = 0; offset < test_data.size(); offset += message_size) {
+    const auto message = net::buffer(test_data.data() + offset, std::min(message_size, test_data.size() - offset));
+    if (offset / message_size % 2 == 0) {
+      CHECK(net::write(client, message) == message.size());
+    } else {
+      net::async_write(client, message, [&message](const error_code& ec, std::size_t length) {
+        CHECK_FALSE(ec);
+        CHECK(length == message.size());
+      });
+      io_context.run();
+      io_context.restart();
+    }
+  }
+  const auto full_records = test_data.size() / loopback_provider::max_message_size;
+  CHECK(loopback_provider::statistics().records_encrypted == full_records);
+
+  // Flushing writes the remaining data and does nothing without any
+  client.flush();
+  error_code flush_ec{};
+  client.async_flush([&flush_ec](const error_code& ec) {
+    flush_ec = ec;
+  });
+  io_context.run();
+  CHECK_FALSE(flush_ec);
+  const auto records = (test_data.size() + loopback_provider::max_message_size - 1) / loopback_provider::max_message_size;
+  CHECK(loopback_provider::statistics().records_encrypted == records);
+
+  std::string received(test_data.size(), '\0');
+  net::read(server, net::buffer(received));
+  CHECK(received == test_data);
+}
+
+TEST_CASE_METHOD(loopback_connection, "cork ordering") {
+  const std::string corked = generate_data(1000);
+  const std::string data(500, 'x');
+  client.set_cork(true);
+  CHECK(net::write(client, net::buffer(corked)) == corked.size());
+
+  // Data corked is always written ahead of data written afterwards
+  SECTION("write after uncorking") {
+    client.set_cork(false);
+    CHECK(client.write_some(net::buffer(data)) == data.size());
+  }
+
+  SECTION("async write after uncorking") {
+    client.set_cork(false);
+    net::async_write(client, net::buffer(data), [&data](const error_code& ec, std::size_t length) {
+      CHECK_FALSE(ec);
+      CHECK(length == data.size());
+    });
+    io_context.run();
+  }
+
+  SECTION("write in place") {
+    const auto layout = client.query_record_layout();
+    std::string record(layout.header_size + data.size() + layout.trailer_size, '\0');
+    data.copy(&record[layout.header_size], data.size());
+    CHECK(client.write_in_place(net::buffer(record), data.size()) == data.size());
+  }
+
+  SECTION("queued write") {
+    client.async_write_queued(net::buffer(data), [&data](const error_code& ec, std::size_t length) {
+      CHECK_FALSE(ec);
+      CHECK(length == data.size());
+    });
+    io_context.run();
+  }
+
+  SECTION("record size reduced") {
+    // The corked record is larger than the records now used, so it is
+    // written before the data is written without being corked
+    wintls::record_sizing sizing;
+    sizing.small_record_size = 500;
+    client.set_record_sizing(sizing);
+    CHECK(client.write_some(net::buffer(data)) == data.size());
+  }
+
+  std::string received(corked.size() + data.size(), '\0');
+  net::read(server, net::buffer(received));
+  CHECK(received == corked + data);
+}
+
+TEST_CASE_METHOD(loopback_connection, "cork shutdown") {
+  const std::string corked = generate_data(1000);
+  client.set_cork(true);
+  CHECK(net::write(client, net::buffer(corked)) == corked.size());
+
+  // Shutting down writes the corked data first
+  const bool async = GENERATE(false, true);
+  if (async) {
+    error_code shutdown_ec{};
+    client.async_shutdown([&shutdown_ec](const error_code& ec) {
+      shutdown_ec = ec;
+    });
+    io_context.run();
+    CHECK_FALSE(shutdown_ec);
+  } else {
+    client.shutdown();
+  }
+
+  std::string received(corked.size(), '\0');
+  net::read(server, net::buffer(received));
+  CHECK(received == corked);
+}
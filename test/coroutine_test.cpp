@@ -0,0 +1,68 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls.hpp>
+
+#include <array>
+#include <exception>
+#include <string>
+
+using wintls::test::generate_data;
+using wintls::test::loopback_fixture;
+
+#if defined(ASIO_HAS_CO_AWAIT) || defined(BOOST_ASIO_HAS_CO_AWAIT)
+TEST_CASE_METHOD(loopback_fixture, "coroutines") {
+  wintls::stream<test_stream> client(io_context, client_ctx);
+  wintls::stream<test_stream> server(io_context, server_ctx);
+  client.next_layer().connect(server.next_layer());
+
+  const std::string test_data = generate_data(0x1000);
+
+  std::exception_ptr client_error;
+  net::co_spawn(io_context, [&]() -> net::awaitable<void> {
+    co_await client.async_handshake(wintls::handshake_type::client, net::use_awaitable);
+    client.set_cork(true);
+    std::size_t size = 0;
+    while (size < test_data.size()) {
+      size += co_await client.async_write_some(net::buffer(test_data) + size, net::use_awaitable);
+    }
+    co_await client.async_flush(net::use_awaitable);
+    co_await client.async_shutdown(net::use_awaitable);
+  }, [&client_error](std::exception_ptr e) { client_error = e; });
+
+  std::exception_ptr server_error;
+  std::string received;
+  std::size_t buffered_reads = 0;
+  error_code read_ec{};
+  error_code shutdown_ec{};
+  net::co_spawn(io_context, [&]() -> net::awaitable<void> {
+    co_await server.async_handshake(wintls::handshake_type::server, net::use_awaitable);
+    // Read using a buffer smaller than the record, leaving decrypted
+    // data to be read without reading from the next layer
+    std::array<char, 0x100> buffer;
+    while (received.size() < test_data.size()) {
+      const auto next_layer_reads = server.statistics().next_layer_reads;
+      const auto size = co_await server.async_read_some(net::buffer(buffer), net::use_awaitable);
+      if (server.statistics().next_layer_reads == next_layer_reads) {
+        ++buffered_reads;
+      }
+      received.append(buffer.data(), size);
+    }
+    co_await server.async_read_some(net::buffer(buffer), net::redirect_error(net::use_awaitable, read_ec));
+    co_await server.async_shutdown(net::redirect_error(net::use_awaitable, shutdown_ec));
+  }, [&server_error](std::exception_ptr e) { server_error = e; });
+
+  io_context.run();
+  CHECK(client_error == nullptr);
+  CHECK(server_error == nullptr);
+  CHECK(received == test_data);
+  CHECK(buffered_reads > 0);
+  CHECK(read_ec);
+  CHECK_FALSE(shutdown_ec);
+}
+#endif // ASIO_HAS_CO_AWAIT || BOOST_ASIO_HAS_CO_AWAIT
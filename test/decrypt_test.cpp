@@ -0,0 +1,59 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls.hpp>
+
+#include <array>
+#include <string>
+
+using wintls::test::generate_data;
+using wintls::test::loopback_connection;
+using wintls::test::loopback_provider;
+
+TEST_CASE_METHOD(loopback_connection, "decrypt") {
+  auto test_data_size = GENERATE(0x100, 0x4000, 0x4000 + 1, 0x10000 + 1, 0x100000);
+  const std::string test_data = generate_data(static_cast<std::size_t>(test_data_size));
+  std::string received(test_data.size(), '\0');
+
+  SECTION("small reads") {
+    // Records are only decrypted once they have been received in full
+    server.next_layer().read_size(0x20);
+    net::write(client, net::buffer(test_data));
+    net::read(server, net::buffer(received));
+    CHECK(received == test_data);
+    CHECK(loopback_provider::statistics().incomplete_messages > 0);
+  }
+
+  SECTION("large reads") {
+    // Buffers large enough to hold whole records are decrypted in place
+    server.next_layer().read_size(0x1000);
+    net::write(client, net::buffer(test_data));
+    net::read(server, net::buffer(received));
+    CHECK(received == test_data);
+  }
+
+  SECTION("multiple records per read") {
+    // All records received by a single read are decrypted at once
+    net::write(client, net::buffer(test_data));
+    std::string buffer(test_data.size() + 0x10000, '\0');
+    const auto size_read = server.read_some(net::buffer(buffer));
+    CHECK(size_read == test_data.size());
+    CHECK(buffer.substr(0, size_read) == test_data);
+
+    // Records decrypted to the internal buffer are copied to all
+    // buffers of the sequence
+    net::write(client, net::buffer(test_data));
+    std::string first(0x10, '\0');
+    std::string second(test_data.size() - first.size(), '\0');
+    std::array<net::mutable_buffer, 2> buffers{net::buffer(first), net::buffer(second)};
+    net::read(server, buffers);
+    CHECK(first + second == test_data);
+  }
+
+  CHECK(loopback_provider::statistics().records_encrypted == loopback_provider::statistics().records_decrypted);
+}
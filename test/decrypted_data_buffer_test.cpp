@@ -12,7 +12,7 @@
 #include <string>
 
 TEST_CASE("decrypted data buffer") {
-  wintls::detail::decrypted_data_buffer<25> test_buffer;
+  wintls::detail::decrypted_data_buffer test_buffer;
   CHECK(test_buffer.empty());
 
   std::string input_str{"abc"};
@@ -39,4 +39,11 @@ TEST_CASE("decrypted data buffer") {
   CHECK(size == 3);
   CHECK(test_buffer.empty());
   CHECK(output_str == "abcg");
+
+  const std::string large_str(0x1000, 'x');
+  test_buffer.fill(net::buffer(large_str));
+  std::string large_output(0x1000, '\0');
+  CHECK(test_buffer.get(net::buffer(large_output)) == large_str.size());
+  CHECK(test_buffer.empty());
+  CHECK(large_output == large_str);
 }
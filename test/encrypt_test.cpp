@@ -0,0 +1,213 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls.hpp>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+using wintls::test::generate_data;
+using wintls::test::loopback_connection;
+using wintls::test::loopback_fixture;
+using wintls::test::loopback_provider;
+
+namespace {
+
+// Test stream recording the size of each buffer of every write
+class recording_stream {
+public:
+  using executor_type = test_stream::executor_type;
+
+  explicit recording_stream(net::io_context& io_context)
+    : next_layer_(io_context) {
+  }
+
+  executor_type get_executor() {
+    return next_layer_.get_executor();
+  }
+
+  test_stream& next_layer() {
+    return next_layer_;
+  }
+
+  template <class MutableBufferSequence>
+  std::size_t read_some(const MutableBufferSequence& buffers, error_code& ec) {
+    return next_layer_.read_some(buffers, ec);
+  }
+
+  template <class MutableBufferSequence, class ReadHandler>
+  auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+    return next_layer_.async_read_some(buffers, std::forward<ReadHandler>(handler));
+  }
+
+  template <class ConstBufferSequence>
+  std::size_t write_some(const ConstBufferSequence& buffers, error_code& ec) {
+    record(buffers);
+    return next_layer_.write_some(buffers, ec);
+  }
+
+  template <class ConstBufferSequence, class WriteHandler>
+  auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+    record(buffers);
+    return next_layer_.async_write_some(buffers, std::forward<WriteHandler>(handler));
+  }
+
+  std::vector<std::vector<std::size_t>> writes;
+
+private:
+  template <class ConstBufferSequence>
+  void record(const ConstBufferSequence& buffers) {
+    std::vector<std::size_t> sizes;
+    for (auto it = net::buffer_sequence_begin(buffers); it != net::buffer_sequence_end(buffers); ++it) {
+      sizes.push_back(net::const_buffer(*it).size());
+    }
+    writes.push_back(std::move(sizes));
+  }
+
+  test_stream next_layer_;
+};
+
+} // namespace
+
+TEST_CASE_METHOD(loopback_connection, "encrypt") {
+  auto test_data_size = GENERATE(0x100, 0x4000, 0x4000 + 1, 0x10000 + 1, 0x100000);
+  const std::string test_data = generate_data(static_cast<std::size_t>(test_data_size));
+
+  SECTION("multiple records per write") {
+    client.set_max_records_per_write(4);
+    const auto size_written = client.write_some(net::buffer(test_data));
+    CHECK(size_written == std::min<std::size_t>(test_data.size(), 4 * loopback_provider::max_message_size));
+
+    std::string received(size_written, '\0');
+    net::read(server, net::buffer(received));
+    CHECK(received == test_data.substr(0, size_written));
+  }
+
+  SECTION("write in place") {
+    const auto layout = client.query_record_layout();
+    CHECK(layout.header_size == loopback_provider::header_size);
+    CHECK(layout.max_data_size == loopback_provider::max_message_size);
+    CHECK(layout.trailer_size == loopback_provider::trailer_size);
+
+    // Send the data as records encrypted in the memory they are
+    // prepared in, alternating between sync and async writes
+    std::string record(layout.header_size + layout.max_data_size + layout.trailer_size, '\0');
+    for (std::size_t offset = 0; offset < test_data.size(); offset += layout.max_data_size) {
+      const auto size = std::min(layout.max_data_size, test_data.size() - offset);
+      test_data.copy(&record[layout.header_size], size, offset);
+      if (offset / layout.max_data_size % 2 == 0) {
+        CHECK(client.write_in_place(net::buffer(record), size) == size);
+      } else {
+        client.async_write_in_place(net::buffer(record), size, [size](const error_code& ec, std::size_t length) {
+          CHECK_FALSE(ec);
+          CHECK(length == size);
+        });
+        io_context.run();
+        io_context.restart();
+      }
+    }
+
+    std::string received(test_data.size(), '\0');
+    net::read(server, net::buffer(received));
+    CHECK(received == test_data);
+
+    // The data must fit in a single record
+    error_code ec{};
+    client.write_in_place(net::buffer(record), layout.max_data_size + 1, ec);
+    CHECK(ec.value() == SEC_E_INVALID_PARAMETER);
+    client.write_in_place(net::buffer(record.data(), record.size() - 1), layout.max_data_size, ec);
+    CHECK(ec.value() == SEC_E_INVALID_PARAMETER);
+  }
+
+  SECTION("buffer sequences") {
+    // Many small buffers, with empty buffers in between, are
+    // encrypted into several records written with a single write
+    std::vector<net::const_buffer> buffers;
+    for (std::size_t offset = 0; offset < test_data.size(); offset += 100) {
+      buffers.push_back(net::buffer(test_data.data() + offset, std::min<std::size_t>(100, test_data.size() - offset)));
+      buffers.push_back(net::const_buffer{});
+    }
+    client.set_max_records_per_write(4);
+    const auto next_layer_writes = client.statistics().next_layer_writes;
+    const auto size_written = client.write_some(buffers);
+    CHECK(size_written == std::min<std::size_t>(test_data.size(), 4 * loopback_provider::max_message_size));
+    CHECK(client.statistics().next_layer_writes == next_layer_writes + 1);
+
+    std::string received(size_written, '\0');
+    net::read(server, net::buffer(received));
+    CHECK(received == test_data.substr(0, size_written));
+  }
+}
+
+TEST_CASE_METHOD(loopback_fixture, "encrypt record buffers") {
+  wintls::stream<recording_stream> client(io_context, client_ctx);
+  wintls::stream<recording_stream> server(io_context, server_ctx);
+  client.next_layer().next_layer().connect(server.next_layer().next_layer());
+  handshake(client, server);
+
+  const std::string corked = generate_data(1000);
+  const std::string data(500, 'x');
+  auto& writes = client.next_layer().writes;
+  writes.clear();
+
+  // Only the buffers of encrypted records are written, without the
+  // empty buffer of a corked record which has not been encrypted
+  const bool async = GENERATE(false, true);
+  auto write = [&](const std::string& message) {
+    if (async) {
+      net::async_write(client, net::buffer(message), [&message](const error_code& ec, std::size_t length) {
+        CHECK_FALSE(ec);
+        CHECK(length == message.size());
+      });
+      io_context.run();
+      io_context.restart();
+    } else {
+      CHECK(net::write(client, net::buffer(message)) == message.size());
+    }
+  };
+
+  write(data);
+  REQUIRE(writes.size() == 1);
+  CHECK(writes[0].size() == 1);
+
+  // The corked record is written ahead of the data in the same write
+  client.set_cork(true);
+  write(corked);
+  CHECK(writes.size() == 1);
+  client.set_cork(false);
+  write(data);
+  REQUIRE(writes.size() == 2);
+  CHECK(writes[1].size() == 2);
+
+  client.set_cork(true);
+  write(corked);
+  if (async) {
+    client.async_flush([](const error_code& ec) {
+      CHECK_FALSE(ec);
+    });
+    io_context.run();
+    io_context.restart();
+  } else {
+    client.flush();
+  }
+  REQUIRE(writes.size() == 3);
+  CHECK(writes[2].size() == 1);
+
+  for (const auto& sizes : writes) {
+    for (const auto size : sizes) {
+      CHECK(size > 0);
+    }
+  }
+
+  const auto expected = data + corked + data + corked;
+  std::string received(expected.size(), '\0');
+  net::read(server, net::buffer(received));
+  CHECK(received == expected);
+}
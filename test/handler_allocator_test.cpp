@@ -0,0 +1,336 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::atomic<std::size_t> global_allocations{0};
+
+} // namespace
+
+// Count all memory allocated with operator new, which the handler
+// allocator below only uses for allocating new blocks.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size) {
+  global_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+namespace {
+
+using wintls::test::loopback_provider;
+using tcp = net::ip::tcp;
+
+// Memory for handlers reusing freed blocks, like a per connection
+// arena would
+class handler_memory {
+public:
+  void* allocate(std::size_t size) {
+    ++allocations;
+    for (auto& b : blocks_) {
+      if (!b.in_use && b.size >= size) {
+        b.in_use = true;
+        return b.data.get();
+      }
+    }
+    blocks_.push_back(block{std::make_unique<char[]>(size), size, true});
+    return blocks_.back().data.get();
+  }
+
+  void deallocate(void* ptr) {
+    for (auto& b : blocks_) {
+      if (b.data.get() == ptr) {
+        b.in_use = false;
+        return;
+      }
+    }
+    FAIL("Deallocating memory not allocated by handler allocator");
+  }
+
+  std::size_t allocations = 0;
+
+private:
+  struct block {
+    std::unique_ptr<char[]> data;
+    std::size_t size;
+    bool in_use;
+  };
+
+  std::vector<block> blocks_;
+};
+
+template <typename T>
+class handler_allocator {
+public:
+  using value_type = T;
+
+  explicit handler_allocator(handler_memory& memory)
+    : memory_(&memory) {
+  }
+
+  template <typename U>
+  handler_allocator(const handler_allocator<U>& other) noexcept
+    : memory_(other.memory_) {
+  }
+
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(memory_->allocate(sizeof(T) * n));
+  }
+
+  void deallocate(T* ptr, std::size_t) {
+    memory_->deallocate(ptr);
+  }
+
+  template <typename U>
+  bool operator==(const handler_allocator<U>& other) const noexcept {
+    return memory_ == other.memory_;
+  }
+
+  template <typename U>
+  bool operator!=(const handler_allocator<U>& other) const noexcept {
+    return memory_ != other.memory_;
+  }
+
+private:
+  template <typename U>
+  friend class handler_allocator;
+
+  handler_memory* memory_;
+};
+
+class ping_pong;
+
+struct handler {
+  using allocator_type = handler_allocator<void>;
+
+  allocator_type get_allocator() const noexcept {
+    return allocator_type{*memory};
+  }
+
+  void operator()(const error_code& ec, std::size_t = 0);
+
+  handler_memory* memory;
+  ping_pong* driver;
+};
+
+// Sends a message from the client in a single record which the server
+// reads in two halves, so the second read completes from the
+// decrypted data. The server echoes the halves with queued writes.
+//
+// All operations are started from completion handlers, like they
+// would in a real application, as Asio only recycles the memory of
+// operations not using the associated allocator from within run().
+class ping_pong {
+public:
+  ping_pong(wintls::stream<tcp::socket>& client, wintls::stream<tcp::socket>& server, handler_memory& memory)
+    : client_(client)
+    , server_(server)
+    , memory_(memory)
+    , handler_{&memory, this}
+    , message_(128, 'x') {
+  }
+
+  // Performs warmup round trips before counting the allocations made
+  // by the rest of them
+  void start(std::size_t warmup, std::size_t rounds) {
+    counted_rounds_ = rounds;
+    rounds_ = warmup + rounds;
+    step_ = 0;
+    next();
+  }
+
+  void completed() {
+    if (--pending_ == 0) {
+      next();
+    }
+  }
+
+  std::size_t rounds() const {
+    return rounds_;
+  }
+
+  std::size_t global_allocations() const {
+    return ::global_allocations.load() - global_allocations_;
+  }
+
+  std::size_t handler_allocations() const {
+    return memory_.allocations - handler_allocations_;
+  }
+
+  const std::array<char, 128>& echoed() const {
+    return echoed_;
+  }
+
+private:
+  void next() {
+    switch (step_++ % 3) {
+      case 0:
+        if (rounds_ == 0) {
+          return;
+        }
+        if (rounds_ == counted_rounds_) {
+          global_allocations_ = ::global_allocations.load();
+          handler_allocations_ = memory_.allocations;
+        }
+        --rounds_;
+        pending_ = 2;
+        client_.async_write_some(net::buffer(message_), handler_);
+        net::async_read(server_, net::buffer(received_.data(), half), handler_);
+        break;
+      case 1:
+        pending_ = 1;
+        net::async_read(server_, net::buffer(received_.data() + half, half), handler_);
+        break;
+      case 2:
+        pending_ = 3;
+        server_.async_write_queued(net::buffer(received_.data(), half), handler_);
+        server_.async_write_queued(net::buffer(received_.data() + half, half), handler_);
+        net::async_read(client_, net::buffer(echoed_), handler_);
+        break;
+    }
+  }
+
+  static constexpr std::size_t half = 64;
+
+  wintls::stream<tcp::socket>& client_;
+  wintls::stream<tcp::socket>& server_;
+  handler_memory& memory_;
+  handler handler_;
+  std::string message_;
+  std::array<char, 128> received_{};
+  std::array<char, 128> echoed_{};
+  std::size_t counted_rounds_ = 0;
+  std::size_t rounds_ = 0;
+  std::size_t step_ = 0;
+  std::size_t global_allocations_ = 0;
+  std::size_t handler_allocations_ = 0;
+  int pending_ = 0;
+};
+
+void handler::operator()(const error_code& ec, std::size_t) {
+  if (ec) {
+    FAIL(ec.message());
+  }
+  driver->completed();
+}
+
+// Handler associated with both an allocator and a strand
+struct strand_handler {
+  using allocator_type = handler_allocator<void>;
+  using executor_type = net::strand<net::io_context::executor_type>;
+
+  allocator_type get_allocator() const noexcept {
+    return allocator_type{*memory};
+  }
+
+  executor_type get_executor() const noexcept {
+    return strand;
+  }
+
+  void operator()(const error_code&, std::size_t) const {
+    *invoked_in_strand = strand.running_in_this_thread();
+  }
+
+  handler_memory* memory;
+  executor_type strand;
+  bool* invoked_in_strand;
+};
+
+} // namespace
+
+TEST_CASE("bound handler associations") {
+  net::io_context io_context;
+  handler_memory memory;
+  bool invoked_in_strand = false;
+  const strand_handler h{&memory, net::make_strand(io_context), &invoked_in_strand};
+
+  SECTION("bind_handler") {
+    auto bound = wintls::detail::bind_handler(h, error_code{}, std::size_t{0});
+    CHECK(net::get_associated_allocator(bound) == h.get_allocator());
+    CHECK(net::get_associated_executor(bound, io_context.get_executor()) == h.strand);
+  }
+
+  SECTION("test stream read") {
+    test_stream reader(io_context);
+    test_stream writer(io_context);
+    reader.connect(writer);
+    std::array<char, 16> buffer;
+    reader.async_read_some(net::buffer(buffer), h);
+    // Completing the read posts the operation and then dispatches the
+    // handler to its strand, both using the memory of the handler
+    const auto allocations = memory.allocations;
+    net::write(writer, net::buffer(std::string(buffer.size(), 'x')));
+    io_context.run();
+    CHECK(invoked_in_strand);
+    CHECK(memory.allocations == allocations + 2);
+  }
+}
+
+TEST_CASE("handler allocator") {
+  loopback_provider::scoped_install provider;
+
+  net::io_context io_context;
+  wintls::context client_ctx(wintls::method::system_default);
+  wintls::context server_ctx(wintls::method::system_default);
+  wintls::stream<tcp::socket> client(io_context, client_ctx);
+  wintls::stream<tcp::socket> server(io_context, server_ctx);
+
+  tcp::acceptor acceptor(io_context, tcp::endpoint(net::ip::address_v4::loopback(), 0));
+  client.next_layer().connect(acceptor.local_endpoint());
+  acceptor.accept(server.next_layer());
+
+  error_code client_ec{};
+  error_code server_ec{};
+  client.async_handshake(wintls::handshake_type::client, [&client_ec](const error_code& ec) { client_ec = ec; });
+  server.async_handshake(wintls::handshake_type::server, [&server_ec](const error_code& ec) { server_ec = ec; });
+  io_context.run();
+  REQUIRE_FALSE(client_ec);
+  REQUIRE_FALSE(server_ec);
+
+  handler_memory memory;
+  ping_pong driver(client, server, memory);
+
+  // Let buffers and the memory recycled by Asio for the thread
+  // running the io_context reach their steady state before counting
+  io_context.restart();
+  net::post(io_context, [&driver]() { driver.start(10, 100); });
+  io_context.run();
+
+  REQUIRE(driver.rounds() == 0);
+  CHECK(driver.global_allocations() == 0);
+  CHECK(driver.handler_allocations() > 0);
+  CHECK(std::string(driver.echoed().data(), driver.echoed().size()) == std::string(128, 'x'));
+}
@@ -223,6 +223,62 @@ std::string cert_container_name(const CERT_CONTEXT* cert) {
   const auto info = reinterpret_cast<CRYPT_KEY_PROV_INFO*>(data.data());
   return wchar_to_string(info->pwszContainerName);
 }
+
+// Counts the credentials acquired while installed, forwarding all
+// calls to the SSPI functions previously in use
+class counting_function_table {
+public:
+  counting_function_table()
+    : previous_(wintls::detail::sspi_functions::custom_function_table().load())
+    , table_(*wintls::sspi_function_table()) {
+    forward_to() = wintls::sspi_function_table();
+    credentials_acquired() = 0;
+    table_.AcquireCredentialsHandleA = &acquire_credentials_handle;
+    wintls::set_sspi_function_table(&table_);
+  }
+
+  counting_function_table(const counting_function_table&) = delete;
+  counting_function_table& operator=(const counting_function_table&) = delete;
+
+  ~counting_function_table() {
+    wintls::set_sspi_function_table(previous_);
+  }
+
+  static std::size_t& credentials_acquired() {
+    static std::size_t count = 0;
+    return count;
+  }
+
+private:
+  static SecurityFunctionTableA*& forward_to() {
+    static SecurityFunctionTableA* table = nullptr;
+    return table;
+  }
+
+  static SECURITY_STATUS SEC_ENTRY acquire_credentials_handle(SEC_CHAR* principal,
+                                                              SEC_CHAR* package,
+                                                              unsigned long usage,
+                                                              void* logon_id,
+                                                              void* auth_data,
+                                                              SEC_GET_KEY_FN get_key,
+                                                              void* get_key_argument,
+                                                              PCredHandle credential,
+                                                              PTimeStamp expiry) {
+    ++credentials_acquired();
+    return forward_to()->AcquireCredentialsHandleA(principal,
+                                                   package,
+                                                   usage,
+                                                   logon_id,
+                                                   auth_data,
+                                                   get_key,
+                                                   get_key_argument,
+                                                   credential,
+                                                   expiry);
+  }
+
+  SecurityFunctionTableA* previous_;
+  SecurityFunctionTableA table_;
+};
 } // namespace
 
 TEST_CASE("certificates") {
@@ -659,6 +715,51 @@ TEST_CASE("failing handshakes") {
   }
 }
 
+TEST_CASE("shared credentials") {
+  counting_function_table functions;
+  net::io_context io_context;
+  wintls_client_context client_ctx;
+  wintls_server_context server_ctx;
+
+  auto handshake = [&]() {
+    wintls::stream<test_stream> client_stream(io_context, client_ctx);
+    wintls::stream<test_stream> server_stream(io_context, server_ctx);
+    client_stream.next_layer().connect(server_stream.next_layer());
+
+    error_code client_error{};
+    error_code server_error{};
+    client_stream.async_handshake(wintls::handshake_type::client,
+                                  [&client_error](const error_code& ec) {
+                                    client_error = ec;
+                                  });
+    server_stream.async_handshake(wintls::handshake_type::server,
+                                  [&server_error](const error_code& ec) {
+                                    server_error = ec;
+                                  });
+    io_context.run();
+    io_context.restart();
+    CHECK_FALSE(client_error);
+    CHECK_FALSE(server_error);
+  };
+
+  // Credentials are acquired once by the client and once by the server
+  SECTION("multiple streams") {
+    handshake();
+    handshake();
+    handshake();
+    CHECK(counting_function_table::credentials_acquired() == 2);
+  }
+
+  SECTION("certificate changed") {
+    handshake();
+    auto cert = x509_to_cert_context(net::buffer(test_certificate), wintls::file_format::pem);
+    wintls::assign_private_key(cert.get(), test_key_name_server);
+    server_ctx.use_certificate(cert.get());
+    handshake();
+    CHECK(counting_function_table::credentials_acquired() == 3);
+  }
+}
+
 TEST_CASE("ssl/tls versions") {
   const auto value = GENERATE(values<std::pair<wintls::method, tls_version>>({
         { wintls::method::tlsv1, tls_version::tls_1_0 },
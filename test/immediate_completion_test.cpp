@@ -0,0 +1,69 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls.hpp>
+
+#include <array>
+#include <string>
+
+using wintls::test::generate_data;
+using wintls::test::loopback_connection;
+
+TEST_CASE_METHOD(loopback_connection, "immediate completion") {
+  const bool immediate = GENERATE(false, true);
+  server.set_immediate_completion(immediate);
+
+  std::array<char, 0x100> buffer;
+  std::string received;
+  bool completed = false;
+  // The handler may only be invoked from within async_read_some by
+  // dispatching it through its immediate executor
+  auto read_some = [&]() {
+    completed = false;
+    server.async_read_some(net::buffer(buffer), net::bind_immediate_executor(io_context.get_executor(), [&](const error_code& ec, std::size_t length) {
+      REQUIRE_FALSE(ec);
+      received.append(buffer.data(), length);
+      completed = true;
+    }));
+  };
+
+  std::string test_data;
+  SECTION("decrypted data") {
+    test_data = generate_data(2 * buffer.size());
+    net::write(client, net::buffer(test_data));
+  }
+
+  SECTION("complete record") {
+    // Each write is sent as a separate record and the first one fills
+    // the buffer of the first read exactly
+    const auto first = generate_data(buffer.size());
+    const auto second = generate_data(buffer.size() / 2);
+    net::write(client, net::buffer(first));
+    net::write(client, net::buffer(second));
+    test_data = first + second;
+  }
+
+  // The first read reads all the data from the next layer
+  read_some();
+  io_context.run();
+  io_context.restart();
+  REQUIRE(completed);
+  CHECK(received.size() == buffer.size());
+
+  const auto next_layer_reads = server.statistics().next_layer_reads;
+  bool completed_inline = false;
+  net::post(io_context, [&]() {
+    read_some();
+    completed_inline = completed;
+  });
+  io_context.run();
+  CHECK(completed_inline == immediate);
+  CHECK(completed);
+  CHECK(received == test_data);
+  CHECK(server.statistics().next_layer_reads == next_layer_reads);
+}
@@ -0,0 +1,680 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#ifndef WINTLS_TEST_LOOPBACK_PROVIDER_HPP
+#define WINTLS_TEST_LOOPBACK_PROVIDER_HPP
+
+#include "unittest.hpp"
+
+#include <wintls/context.hpp>
+#include <wintls/function_table.hpp>
+#include <wintls/stream.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace wintls {
+namespace test {
+
+// Deterministic in-process stand-in for Schannel.
+//
+// Implements just enough of the SSPI function table for wintls
+// streams to perform handshakes, exchange data and shut down with
+// each other. Records are framed like TLS records and "encrypted"
+// with a cheap keystream and checksum trailer which makes it
+// possible to measure the overhead of the stream itself, optionally
+// with a simulated CPU cost for the cryptographic operations.
+//
+// Only usable between two streams both using the loopback provider.
+class loopback_provider {
+public:
+  struct options {
+    // Busy wait for this long for each handshake message processed
+    std::chrono::nanoseconds handshake_cost{0};
+
+    // Busy wait for this long for each record encrypted or decrypted
+    std::chrono::nanoseconds record_cost{0};
+
+    // Certificate returned as the certificate of the remote peer
+    const CERT_CONTEXT* remote_certificate = nullptr;
+
+    // Sleep for this long when the remote certificate is queried,
+    // simulating a certificate verification blocking on the network
+    std::chrono::nanoseconds remote_certificate_delay{0};
+  };
+
+  struct counters {
+    std::atomic<std::size_t> credentials_acquired{0};
+    std::atomic<std::size_t> contexts_created{0};
+    std::atomic<std::size_t> records_encrypted{0};
+    std::atomic<std::size_t> records_decrypted{0};
+    std::atomic<std::size_t> incomplete_messages{0};
+    std::atomic<std::size_t> sessions_resumed{0};
+  };
+
+  static constexpr unsigned long header_size = 5;
+  static constexpr unsigned long trailer_size = 16;
+  static constexpr unsigned long max_message_size = 0x4000;
+
+  static SecurityFunctionTableA* function_table() {
+    static SecurityFunctionTableA table = make_function_table();
+    return &table;
+  }
+
+  static options& config() {
+    static options opts;
+    return opts;
+  }
+
+  static counters& statistics() {
+    static counters stats;
+    return stats;
+  }
+
+  static void reset_statistics() {
+    auto& stats = statistics();
+    stats.credentials_acquired = 0;
+    stats.contexts_created = 0;
+    stats.records_encrypted = 0;
+    stats.records_decrypted = 0;
+    stats.incomplete_messages = 0;
+    stats.sessions_resumed = 0;
+  }
+
+  // Installs the loopback provider for the lifetime of the object
+  class scoped_install {
+  public:
+    scoped_install()
+      : scoped_install(options()) {
+    }
+
+    explicit scoped_install(const options& opts)
+      : previous_(detail::sspi_functions::custom_function_table().load()) {
+      config() = opts;
+      wintls::set_sspi_function_table(function_table());
+    }
+
+    scoped_install(const scoped_install&) = delete;
+    scoped_install& operator=(const scoped_install&) = delete;
+
+    ~scoped_install() {
+      wintls::set_sspi_function_table(previous_);
+    }
+
+  private:
+    SecurityFunctionTableA* previous_;
+  };
+
+private:
+  enum record_type : std::uint8_t {
+    alert = 21,
+    handshake = 22,
+    application_data = 23
+  };
+
+  enum handshake_message : std::uint8_t {
+    client_hello = 1,
+    server_hello = 2
+  };
+
+  static constexpr std::size_t hello_size = 32;
+
+  // Like Schannel, sessions are kept in the credentials. Clients
+  // remember the session established with each target name and ask
+  // the server to resume it, which it does if the session is still
+  // in its cache. The sessions are guarded by a mutex as credentials
+  // are shared by streams handshaking on different threads.
+  struct credentials {
+    unsigned long usage;
+    std::chrono::milliseconds session_lifespan;
+    bool reconnects;
+    std::mutex mutex{};
+    std::map<std::string, std::uint64_t> client_sessions{};
+    std::map<std::uint64_t, std::chrono::steady_clock::time_point> server_sessions{};
+  };
+
+  struct context {
+    bool server;
+    std::string target{};
+    std::uint64_t session_id = 0;
+    bool resumed = false;
+    bool shutdown_requested = false;
+    std::uint64_t write_sequence = 0;
+    std::uint64_t read_sequence = 0;
+  };
+
+  static SecurityFunctionTableA make_function_table() {
+    SecurityFunctionTableA table{};
+    table.dwVersion = SECURITY_SUPPORT_PROVIDER_INTERFACE_VERSION;
+    table.AcquireCredentialsHandleA = &acquire_credentials_handle;
+    table.FreeCredentialsHandle = &free_credentials_handle;
+    table.InitializeSecurityContextA = &initialize_security_context;
+    table.AcceptSecurityContext = &accept_security_context;
+    table.DeleteSecurityContext = &delete_security_context;
+    table.ApplyControlToken = &apply_control_token;
+    table.QueryContextAttributesA = &query_context_attributes;
+    table.FreeContextBuffer = &free_context_buffer;
+    table.EncryptMessage = &encrypt_message;
+    table.DecryptMessage = &decrypt_message;
+    return table;
+  }
+
+  static void spin(std::chrono::nanoseconds duration) {
+    if (duration.count() == 0) {
+      return;
+    }
+    const auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end) {
+    }
+  }
+
+  template <typename T>
+  static T* from_handle(PSecHandle handle) {
+    if (handle == nullptr || handle->dwLower == 0) {
+      return nullptr;
+    }
+    return reinterpret_cast<T*>(handle->dwLower);
+  }
+
+  template <typename T>
+  static void to_handle(PSecHandle handle, T* ptr) {
+    handle->dwLower = reinterpret_cast<ULONG_PTR>(ptr);
+    handle->dwUpper = 0;
+  }
+
+  static SecBuffer* find_buffer(PSecBufferDesc desc, unsigned long type) {
+    if (desc == nullptr) {
+      return nullptr;
+    }
+    for (unsigned long i = 0; i < desc->cBuffers; ++i) {
+      if (desc->pBuffers[i].BufferType == type) {
+        return &desc->pBuffers[i];
+      }
+    }
+    return nullptr;
+  }
+
+  static std::size_t record_length(const unsigned char* data) {
+    return header_size + (static_cast<std::size_t>(data[3]) << 8 | data[4]);
+  }
+
+  static void write_header(unsigned char* data, record_type type, std::size_t length) {
+    data[0] = type;
+    data[1] = 3;
+    data[2] = 3;
+    data[3] = static_cast<unsigned char>(length >> 8);
+    data[4] = static_cast<unsigned char>(length & 0xff);
+  }
+
+  // XORs the data with a keystream derived from the sequence number,
+  // processing a word at a time to keep the cost per byte low.
+  static void apply_keystream(unsigned char* data, std::size_t size, std::uint64_t sequence) {
+    std::uint64_t key = (sequence + 1) * 0x9e3779b97f4a7c15ULL;
+    std::size_t i = 0;
+    for (; i + sizeof(key) <= size; i += sizeof(key)) {
+      std::uint64_t word;
+      std::memcpy(&word, data + i, sizeof(word));
+      word ^= key;
+      std::memcpy(data + i, &word, sizeof(word));
+      key = key * 0xbf58476d1ce4e5b9ULL + 1;
+    }
+    for (; i < size; ++i) {
+      data[i] ^= static_cast<unsigned char>(key >> ((i % 8) * 8));
+    }
+  }
+
+  static std::array<unsigned char, trailer_size> checksum(const unsigned char* data, std::size_t size, std::uint64_t sequence) {
+    // FNV-1a like hash over the plaintext words seeded with the sequence number
+    std::uint64_t hash = 0xcbf29ce484222325ULL ^ sequence;
+    std::size_t i = 0;
+    for (; i + sizeof(hash) <= size; i += sizeof(hash)) {
+      std::uint64_t word;
+      std::memcpy(&word, data + i, sizeof(word));
+      hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+    for (; i < size; ++i) {
+      hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    std::array<unsigned char, trailer_size> result;
+    for (std::size_t j = 0; j < trailer_size; ++j) {
+      result[j] = static_cast<unsigned char>(hash >> ((j % 8) * 8));
+    }
+    return result;
+  }
+
+  // Writes a single record into a newly allocated token buffer
+  static void make_token(PSecBufferDesc output, record_type type, const unsigned char* payload, std::size_t size) {
+    auto token = new unsigned char[header_size + size];
+    write_header(token, type, size);
+    std::memcpy(token + header_size, payload, size);
+    output->pBuffers[0].BufferType = SECBUFFER_TOKEN;
+    output->pBuffers[0].pvBuffer = token;
+    output->pBuffers[0].cbBuffer = static_cast<unsigned long>(header_size + size);
+  }
+
+  // Hello messages carry the session to resume or the one established
+  static void make_hello(PSecBufferDesc output, handshake_message message, std::uint64_t session_id) {
+    std::array<unsigned char, hello_size> payload;
+    payload[0] = message;
+    for (std::size_t i = 1; i < payload.size(); ++i) {
+      payload[i] = static_cast<unsigned char>(i);
+    }
+    for (std::size_t i = 0; i < sizeof(session_id); ++i) {
+      payload[1 + i] = static_cast<unsigned char>(session_id >> (i * 8));
+    }
+    make_token(output, handshake, payload.data(), payload.size());
+  }
+
+  static void make_close_notify(PSecBufferDesc output) {
+    const std::array<unsigned char, 2> payload{1, 0};
+    make_token(output, alert, payload.data(), payload.size());
+  }
+
+  // Consumes a single handshake record from the input token, flagging
+  // any data following it as extra data.
+  static SECURITY_STATUS read_token(PSecBufferDesc input, handshake_message expected, std::uint64_t& session_id) {
+    if (input == nullptr || input->cBuffers < 1) {
+      return SEC_E_INVALID_TOKEN;
+    }
+    auto& token = input->pBuffers[0];
+    const auto data = static_cast<const unsigned char*>(token.pvBuffer);
+    if (token.cbBuffer < header_size || token.cbBuffer < record_length(data)) {
+      ++statistics().incomplete_messages;
+      return SEC_E_INCOMPLETE_MESSAGE;
+    }
+    const auto length = record_length(data);
+    if (data[0] != handshake || length != header_size + hello_size || data[header_size] != expected) {
+      return SEC_E_INVALID_TOKEN;
+    }
+    spin(config().handshake_cost);
+    session_id = 0;
+    for (std::size_t i = 0; i < sizeof(session_id); ++i) {
+      session_id |= static_cast<std::uint64_t>(data[header_size + 1 + i]) << (i * 8);
+    }
+    if (input->cBuffers > 1 && token.cbBuffer > length) {
+      input->pBuffers[1].BufferType = SECBUFFER_EXTRA;
+      input->pBuffers[1].cbBuffer = static_cast<unsigned long>(token.cbBuffer - length);
+    }
+    return SEC_E_OK;
+  }
+
+  static SECURITY_STATUS SEC_ENTRY acquire_credentials_handle(SEC_CHAR*,
+                                                              SEC_CHAR*,
+                                                              unsigned long usage,
+                                                              void*,
+                                                              void* auth_data,
+                                                              SEC_GET_KEY_FN,
+                                                              void*,
+                                                              PCredHandle credential,
+                                                              PTimeStamp) {
+    if (credential == nullptr) {
+      return SEC_E_INVALID_HANDLE;
+    }
+    DWORD session_lifespan = 0;
+    DWORD flags = 0;
+    if (auth_data != nullptr && *static_cast<const DWORD*>(auth_data) == SCH_CREDENTIALS_VERSION) {
+      const auto creds = static_cast<const SCH_CREDENTIALS*>(auth_data);
+      session_lifespan = creds->dwSessionLifespan;
+      flags = creds->dwFlags;
+    } else if (auth_data != nullptr) {
+      const auto creds = static_cast<const SCHANNEL_CRED*>(auth_data);
+      session_lifespan = creds->dwSessionLifespan;
+      flags = creds->dwFlags;
+    }
+    // Schannel keeps sessions for 10 hours by default
+    const auto lifespan = session_lifespan != 0 ? std::chrono::milliseconds(session_lifespan)
+                                                : std::chrono::hours(10);
+    to_handle(credential, new credentials{usage, lifespan, (flags & SCH_CRED_DISABLE_RECONNECTS) == 0});
+    ++statistics().credentials_acquired;
+    return SEC_E_OK;
+  }
+
+  static SECURITY_STATUS SEC_ENTRY free_credentials_handle(PCredHandle credential) {
+    auto creds = from_handle<credentials>(credential);
+    if (creds == nullptr) {
+      return SEC_E_INVALID_HANDLE;
+    }
+    delete creds;
+    return SEC_E_OK;
+  }
+
+  static SECURITY_STATUS SEC_ENTRY initialize_security_context(PCredHandle credential,
+                                                               PCtxtHandle ctxt,
+                                                               SEC_CHAR* target,
+                                                               unsigned long,
+                                                               unsigned long,
+                                                               unsigned long,
+                                                               PSecBufferDesc input,
+                                                               unsigned long,
+                                                               PCtxtHandle new_ctxt,
+                                                               PSecBufferDesc output,
+                                                               unsigned long* attributes,
+                                                               PTimeStamp) {
+    if (attributes != nullptr) {
+      *attributes = 0;
+    }
+    auto creds = from_handle<credentials>(credential);
+    auto state = from_handle<context>(ctxt);
+    if (state == nullptr) {
+      if (creds == nullptr || new_ctxt == nullptr || output == nullptr) {
+        return SEC_E_INVALID_HANDLE;
+      }
+      spin(config().handshake_cost);
+      state = new context{false};
+      state->target = target != nullptr ? target : "";
+      {
+        std::lock_guard<std::mutex> lock(creds->mutex);
+        const auto session = creds->client_sessions.find(state->target);
+        if (!state->target.empty() && session != creds->client_sessions.end()) {
+          state->session_id = session->second;
+        }
+      }
+      to_handle(new_ctxt, state);
+      ++statistics().contexts_created;
+      make_hello(output, client_hello, state->session_id);
+      return SEC_I_CONTINUE_NEEDED;
+    }
+
+    if (state->shutdown_requested) {
+      make_close_notify(output);
+      return SEC_E_OK;
+    }
+
+    std::uint64_t session_id = 0;
+    const auto sc = read_token(input, server_hello, session_id);
+    if (sc == SEC_E_OK && creds != nullptr) {
+      state->resumed = session_id != 0 && session_id == state->session_id;
+      state->session_id = session_id;
+      std::lock_guard<std::mutex> lock(creds->mutex);
+      if (session_id != 0 && !state->target.empty()) {
+        creds->client_sessions[state->target] = session_id;
+      } else {
+        creds->client_sessions.erase(state->target);
+      }
+      if (state->resumed) {
+        ++statistics().sessions_resumed;
+      }
+    }
+    return sc;
+  }
+
+  static SECURITY_STATUS SEC_ENTRY accept_security_context(PCredHandle credential,
+                                                           PCtxtHandle ctxt,
+                                                           PSecBufferDesc input,
+                                                           unsigned long,
+                                                           unsigned long,
+                                                           PCtxtHandle new_ctxt,
+                                                           PSecBufferDesc output,
+                                                           unsigned long* attributes,
+                                                           PTimeStamp) {
+    if (attributes != nullptr) {
+      *attributes = 0;
+    }
+    auto state = from_handle<context>(ctxt);
+    if (state != nullptr && state->shutdown_requested) {
+      make_close_notify(output);
+      return SEC_E_OK;
+    }
+    auto creds = from_handle<credentials>(credential);
+    if (creds == nullptr || new_ctxt == nullptr || output == nullptr) {
+      return SEC_E_INVALID_HANDLE;
+    }
+
+    std::uint64_t session_id = 0;
+    const auto sc = read_token(input, client_hello, session_id);
+    if (sc != SEC_E_OK) {
+      return sc;
+    }
+    if (state == nullptr) {
+      state = new context{true};
+      to_handle(new_ctxt, state);
+      ++statistics().contexts_created;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(creds->mutex);
+    // Expired sessions are removed from the cache like Schannel does
+    auto& sessions = creds->server_sessions;
+    for (auto it = sessions.begin(); it != sessions.end();) {
+      it = now < it->second ? std::next(it) : sessions.erase(it);
+    }
+    state->resumed = creds->reconnects && sessions.find(session_id) != sessions.end();
+    if (state->resumed) {
+      state->session_id = session_id;
+    } else if (creds->reconnects) {
+      static std::atomic<std::uint64_t> next_session_id{0};
+      state->session_id = ++next_session_id;
+      sessions[state->session_id] = now + creds->session_lifespan;
+    }
+    make_hello(output, server_hello, state->session_id);
+    return SEC_E_OK;
+  }
+
+  static SECURITY_STATUS SEC_ENTRY delete_security_context(PCtxtHandle ctxt) {
+    auto state = from_handle<context>(ctxt);
+    if (state == nullptr) {
+      return SEC_E_INVALID_HANDLE;
+    }
+    delete state;
+    return SEC_E_OK;
+  }
+
+  static SECURITY_STATUS SEC_ENTRY apply_control_token(PCtxtHandle ctxt, PSecBufferDesc input) {
+    auto state = from_handle<context>(ctxt);
+    if (state == nullptr) {
+      return SEC_E_INVALID_HANDLE;
+    }
+    auto token = find_buffer(input, SECBUFFER_TOKEN);
+    if (token == nullptr || token->cbBuffer < sizeof(std::uint32_t)) {
+      return SEC_E_INVALID_TOKEN;
+    }
+    std::uint32_t type = 0;
+    std::memcpy(&type, token->pvBuffer, sizeof(type));
+    if (type != SCHANNEL_SHUTDOWN) {
+      return SEC_E_UNSUPPORTED_FUNCTION;
+    }
+    state->shutdown_requested = true;
+    return SEC_E_OK;
+  }
+
+  static SECURITY_STATUS SEC_ENTRY query_context_attributes(PCtxtHandle ctxt, unsigned long attribute, void* buffer) {
+    auto state = from_handle<context>(ctxt);
+    if (state == nullptr) {
+      return SEC_E_INVALID_HANDLE;
+    }
+    switch (attribute) {
+      case SECPKG_ATTR_STREAM_SIZES: {
+        auto sizes = static_cast<SecPkgContext_StreamSizes*>(buffer);
+        sizes->cbHeader = header_size;
+        sizes->cbTrailer = trailer_size;
+        sizes->cbMaximumMessage = max_message_size;
+        sizes->cBuffers = 4;
+        sizes->cbBlockSize = 16;
+        return SEC_E_OK;
+      }
+      case SECPKG_ATTR_SESSION_INFO: {
+        auto info = static_cast<SecPkgContext_SessionInfo*>(buffer);
+        *info = SecPkgContext_SessionInfo{};
+        info->dwFlags = state->resumed ? SSL_SESSION_RECONNECT : 0;
+        return SEC_E_OK;
+      }
+      case SECPKG_ATTR_REMOTE_CERT_CONTEXT: {
+        if (config().remote_certificate == nullptr) {
+          return SEC_E_NO_CREDENTIALS;
+        }
+        std::this_thread::sleep_for(config().remote_certificate_delay);
+        *static_cast<const CERT_CONTEXT**>(buffer) = CertDuplicateCertificateContext(config().remote_certificate);
+        return SEC_E_OK;
+      }
+      default:
+        return SEC_E_UNSUPPORTED_FUNCTION;
+    }
+  }
+
+  static SECURITY_STATUS SEC_ENTRY free_context_buffer(PVOID buffer) {
+    delete[] static_cast<unsigned char*>(buffer);
+    return SEC_E_OK;
+  }
+
+  static SECURITY_STATUS SEC_ENTRY encrypt_message(PCtxtHandle ctxt, unsigned long, PSecBufferDesc message, unsigned long) {
+    auto state = from_handle<context>(ctxt);
+    if (state == nullptr) {
+      return SEC_E_INVALID_HANDLE;
+    }
+    auto header = find_buffer(message, SECBUFFER_STREAM_HEADER);
+    auto data = find_buffer(message, SECBUFFER_DATA);
+    auto trailer = find_buffer(message, SECBUFFER_STREAM_TRAILER);
+    if (header == nullptr || data == nullptr || trailer == nullptr ||
+        header->cbBuffer < header_size || trailer->cbBuffer < trailer_size ||
+        data->cbBuffer > max_message_size) {
+      return SEC_E_BUFFER_TOO_SMALL;
+    }
+    spin(config().record_cost);
+
+    const auto sequence = state->write_sequence++;
+    auto plaintext = static_cast<unsigned char*>(data->pvBuffer);
+    const auto mac = checksum(plaintext, data->cbBuffer, sequence);
+    apply_keystream(plaintext, data->cbBuffer, sequence);
+    write_header(static_cast<unsigned char*>(header->pvBuffer), application_data, data->cbBuffer + trailer_size);
+    header->cbBuffer = header_size;
+    std::memcpy(trailer->pvBuffer, mac.data(), mac.size());
+    trailer->cbBuffer = trailer_size;
+    ++statistics().records_encrypted;
+    return SEC_E_OK;
+  }
+
+  static SECURITY_STATUS SEC_ENTRY decrypt_message(PCtxtHandle ctxt, PSecBufferDesc message, unsigned long, unsigned long*) {
+    auto state = from_handle<context>(ctxt);
+    if (state == nullptr) {
+      return SEC_E_INVALID_HANDLE;
+    }
+    if (message == nullptr || message->cBuffers < 4 || message->pBuffers[0].BufferType != SECBUFFER_DATA) {
+      return SEC_E_INVALID_TOKEN;
+    }
+
+    auto buffers = message->pBuffers;
+    const auto size = buffers[0].cbBuffer;
+    const auto data = static_cast<unsigned char*>(buffers[0].pvBuffer);
+    if (size < header_size || size < record_length(data)) {
+      const auto missing = size < header_size ? header_size - size : record_length(data) - size;
+      buffers[0].BufferType = SECBUFFER_MISSING;
+      buffers[0].cbBuffer = static_cast<unsigned long>(missing);
+      ++statistics().incomplete_messages;
+      return SEC_E_INCOMPLETE_MESSAGE;
+    }
+
+    const auto length = record_length(data);
+    const auto extra_size = size - length;
+    if (extra_size > 0) {
+      buffers[3].BufferType = SECBUFFER_EXTRA;
+      buffers[3].pvBuffer = data + length;
+      buffers[3].cbBuffer = static_cast<unsigned long>(extra_size);
+    }
+
+    if (data[0] == alert) {
+      return SEC_I_CONTEXT_EXPIRED;
+    }
+    if (data[0] != application_data || length < header_size + trailer_size) {
+      return SEC_E_DECRYPT_FAILURE;
+    }
+    spin(config().record_cost);
+
+    const auto sequence = state->read_sequence++;
+    const auto plaintext_size = length - header_size - trailer_size;
+    auto plaintext = data + header_size;
+    apply_keystream(plaintext, plaintext_size, sequence);
+    const auto mac = checksum(plaintext, plaintext_size, sequence);
+    if (std::memcmp(mac.data(), plaintext + plaintext_size, mac.size()) != 0) {
+      return SEC_E_MESSAGE_ALTERED;
+    }
+
+    buffers[0].BufferType = SECBUFFER_STREAM_HEADER;
+    buffers[0].cbBuffer = header_size;
+    buffers[1].BufferType = SECBUFFER_DATA;
+    buffers[1].pvBuffer = plaintext;
+    buffers[1].cbBuffer = static_cast<unsigned long>(plaintext_size);
+    buffers[2].BufferType = SECBUFFER_STREAM_TRAILER;
+    buffers[2].pvBuffer = plaintext + plaintext_size;
+    buffers[2].cbBuffer = trailer_size;
+    ++statistics().records_decrypted;
+    return SEC_E_OK;
+  }
+};
+
+// Deterministic test data of the given size, terminated by a null
+// character as expected by the echo clients and servers
+inline std::string generate_data(std::size_t size) {
+  std::string ret(size, '\0');
+  for (std::size_t i = 0; i < size - 1; ++i) {
+    ret[i] = static_cast<char>(i % 26 + 65);
+  }
+  return ret;
+}
+
+// Test fixture installing the loopback provider with a client and a
+// server context for creating streams connected to each other.
+struct loopback_fixture {
+  loopback_fixture()
+    : loopback_fixture(loopback_provider::options()) {
+  }
+
+  explicit loopback_fixture(const loopback_provider::options& opts)
+    : provider(opts) {
+    loopback_provider::reset_statistics();
+  }
+
+  // Performs the handshake between two already connected streams
+  template <class NextLayer>
+  void handshake(wintls::stream<NextLayer>& client, wintls::stream<NextLayer>& server) {
+    error_code client_ec{};
+    error_code server_ec{};
+    client.async_handshake(wintls::handshake_type::client, [&client_ec](const error_code& ec) {
+      client_ec = ec;
+    });
+    server.async_handshake(wintls::handshake_type::server, [&server_ec](const error_code& ec) {
+      server_ec = ec;
+    });
+    io_context.run();
+    io_context.restart();
+    REQUIRE_FALSE(client_ec);
+    REQUIRE_FALSE(server_ec);
+  }
+
+  // Connects two test streams and performs the handshake between them
+  void connect(wintls::stream<test_stream>& client, wintls::stream<test_stream>& server) {
+    client.next_layer().connect(server.next_layer());
+    handshake(client, server);
+  }
+
+  loopback_provider::scoped_install provider;
+  net::io_context io_context;
+  wintls::context client_ctx{wintls::method::system_default};
+  wintls::context server_ctx{wintls::method::system_default};
+};
+
+// Test fixture with a client and a server stream which have completed
+// the handshake with each other.
+struct loopback_connection : loopback_fixture {
+  loopback_connection()
+    : client(io_context, client_ctx)
+    , server(io_context, server_ctx) {
+    connect(client, server);
+  }
+
+  wintls::stream<test_stream> client;
+  wintls::stream<test_stream> server;
+};
+
+} // namespace test
+} // namespace wintls
+
+#endif // WINTLS_TEST_LOOPBACK_PROVIDER_HPP
@@ -0,0 +1,95 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "echo_server.hpp"
+#include "echo_client.hpp"
+#include "async_echo_server.hpp"
+#include "async_echo_client.hpp"
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls.hpp>
+
+#include <string>
+
+namespace {
+using wintls::test::generate_data;
+using wintls::test::loopback_fixture;
+using wintls::test::loopback_provider;
+
+struct loopback_stream {
+  using handshake_type = wintls::handshake_type;
+
+  template <class... Args>
+  loopback_stream(Args&&... args)
+    : ctx(wintls::method::system_default)
+    , tst(std::forward<Args>(args)...)
+    , stream(tst, ctx) {
+  }
+
+  wintls::context ctx;
+  test_stream tst;
+  wintls::stream<test_stream&> stream;
+};
+
+}
+
+TEST_CASE("loopback provider") {
+  loopback_provider::scoped_install provider;
+  loopback_provider::reset_statistics();
+
+  REQUIRE(wintls::sspi_function_table() == loopback_provider::function_table());
+
+  auto test_data_size = GENERATE(0x100, 0x4000, 0x4000 + 1, 0x10000 + 1, 0x100000);
+  const std::string test_data = generate_data(static_cast<std::size_t>(test_data_size));
+
+  net::io_context io_context;
+
+  SECTION("sync test") {
+    echo_client<loopback_stream> client(io_context);
+    echo_server<loopback_stream> server(io_context);
+
+    client.stream.next_layer().connect(server.stream.next_layer());
+
+    auto handshake_result = server.handshake();
+    client.handshake();
+    REQUIRE_FALSE(handshake_result.get());
+
+    client.write(test_data);
+    server.read();
+    server.write();
+    client.read();
+
+    auto shutdown_result = server.shutdown();
+    client.shutdown();
+    REQUIRE_FALSE(shutdown_result.get());
+
+    CHECK(client.template data<std::string>() == test_data);
+  }
+
+  SECTION("async test") {
+    async_echo_server<loopback_stream> server(io_context);
+    async_echo_client<loopback_stream> client(io_context, test_data);
+    client.stream.next_layer().connect(server.stream.next_layer());
+    server.run();
+    client.run();
+    io_context.run();
+    CHECK(client.received_message() == test_data);
+  }
+
+  CHECK(loopback_provider::statistics().contexts_created == 2);
+  CHECK(loopback_provider::statistics().records_encrypted == loopback_provider::statistics().records_decrypted);
+}
+
+TEST_CASE_METHOD(loopback_fixture, "loopback provider shared credentials") {
+  for (int i = 0; i < 4; ++i) {
+    wintls::stream<test_stream> client(io_context, client_ctx);
+    wintls::stream<test_stream> server(io_context, server_ctx);
+    connect(client, server);
+  }
+
+  CHECK(loopback_provider::statistics().credentials_acquired == 2);
+  CHECK(loopback_provider::statistics().contexts_created == 8);
+}
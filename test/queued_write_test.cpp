@@ -0,0 +1,166 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls.hpp>
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using wintls::test::generate_data;
+using wintls::test::loopback_connection;
+using wintls::test::loopback_fixture;
+
+TEST_CASE_METHOD(loopback_connection, "full duplex") {
+  std::vector<std::string> messages;
+  std::string test_data;
+  for (std::size_t i = 0; i < 200; ++i) {
+    messages.push_back(generate_data(1 + (i * 7919) % 0x9000));
+    test_data += messages.back();
+  }
+
+  SECTION("queued writes") {
+    const auto client_strand = net::make_strand(io_context);
+    const auto server_strand = net::make_strand(io_context);
+
+    // Assertions are only made once all threads are done as Catch is
+    // not thread safe
+    error_code client_ec{};
+    error_code server_ec{};
+    auto failed = [](error_code& result, const error_code& ec) {
+      if (ec && !result) {
+        result = ec;
+      }
+      return ec.failed();
+    };
+
+    // The server echoes everything it reads while reading more
+    std::array<char, 0x1000> server_buffer;
+    std::size_t server_received = 0;
+    std::function<void()> server_read = [&]() {
+      server.async_read_some(net::buffer(server_buffer), net::bind_executor(server_strand, [&](const error_code& ec, std::size_t length) {
+        if (failed(server_ec, ec)) {
+          return;
+        }
+        auto echo = std::make_shared<std::string>(server_buffer.data(), length);
+        server.async_write_queued(net::buffer(*echo), net::bind_executor(server_strand, [&, echo](const error_code& write_ec, std::size_t) {
+          failed(server_ec, write_ec);
+        }));
+        server_received += length;
+        if (server_received < test_data.size()) {
+          server_read();
+        }
+      }));
+    };
+
+    // The client queues all messages at once while reading the echo
+    std::string received;
+    std::array<char, 0x1000> client_buffer;
+    std::function<void()> client_read = [&]() {
+      client.async_read_some(net::buffer(client_buffer), net::bind_executor(client_strand, [&](const error_code& ec, std::size_t length) {
+        if (failed(client_ec, ec)) {
+          return;
+        }
+        received.append(client_buffer.data(), length);
+        if (received.size() < test_data.size()) {
+          client_read();
+        }
+      }));
+    };
+
+    std::size_t size_written = 0;
+    std::size_t writes_completed = 0;
+    net::dispatch(client_strand, [&]() {
+      client_read();
+      for (const auto& message : messages) {
+        client.async_write_queued(net::buffer(message), net::bind_executor(client_strand, [&](const error_code& ec, std::size_t length) {
+          failed(client_ec, ec);
+          size_written += length;
+          ++writes_completed;
+        }));
+      }
+    });
+    net::dispatch(server_strand, server_read);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+      threads.emplace_back([this]() { io_context.run(); });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    CHECK_FALSE(client_ec);
+    CHECK_FALSE(server_ec);
+    CHECK(writes_completed == messages.size());
+    CHECK(size_written == test_data.size());
+    CHECK(received == test_data);
+    // Messages queued while writing are written together
+    CHECK(client.statistics().next_layer_writes < messages.size());
+  }
+
+  SECTION("synchronous reads and writes") {
+    std::thread server_thread([&]() {
+      std::array<char, 0x1000> buffer;
+      std::size_t size = 0;
+      while (size < test_data.size()) {
+        const auto length = server.read_some(net::buffer(buffer));
+        net::write(server, net::buffer(buffer.data(), length));
+        size += length;
+      }
+    });
+
+    std::thread writer_thread([&]() {
+      for (const auto& message : messages) {
+        net::write(client, net::buffer(message));
+      }
+    });
+
+    std::string received(test_data.size(), '\0');
+    net::read(client, net::buffer(received));
+    writer_thread.join();
+    server_thread.join();
+    CHECK(received == test_data);
+  }
+}
+
+TEST_CASE_METHOD(loopback_fixture, "queued writes stream destroyed") {
+  auto client = std::make_unique<wintls::stream<test_stream>>(io_context, client_ctx);
+  wintls::stream<test_stream> server(io_context, server_ctx);
+  connect(*client, server);
+
+  const auto message = generate_data(0x1000);
+  std::vector<error_code> results;
+  auto handler_state = std::make_shared<int>(0);
+  std::weak_ptr<int> handler_state_alive = handler_state;
+  for (int i = 0; i < 4; ++i) {
+    client->async_write_queued(net::buffer(message), [&results, handler_state](const error_code& ec, std::size_t) {
+      results.push_back(ec);
+    });
+  }
+  handler_state.reset();
+
+  // The first write is in progress on the next layer while the others
+  // are queued
+  client.reset();
+  io_context.run();
+
+  REQUIRE(results.size() == 4);
+  CHECK_FALSE(results[0]);
+  for (std::size_t i = 1; i < results.size(); ++i) {
+    CHECK(results[i] == net::error::operation_aborted);
+  }
+  CHECK(handler_state_alive.expired());
+
+  std::string received(message.size(), '\0');
+  net::read(server, net::buffer(received));
+  CHECK(received == message);
+}
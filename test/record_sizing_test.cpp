@@ -0,0 +1,70 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+using wintls::test::generate_data;
+using wintls::test::loopback_connection;
+
+TEST_CASE_METHOD(loopback_connection, "dynamic record sizing") {
+  wintls::record_sizing sizing;
+  sizing.small_record_size = 1000;
+  sizing.ramp_up_size = 5000;
+  sizing.idle_timeout = std::chrono::milliseconds(200);
+  client.set_record_sizing(sizing);
+  client.set_max_records_per_write(4);
+
+  auto echo = [&](std::size_t size) {
+    const std::string test_data = generate_data(size);
+    net::write(client, net::buffer(test_data));
+    std::string received(test_data.size(), '\0');
+    net::read(server, net::buffer(received));
+    CHECK(received == test_data);
+  };
+
+  // The first 5000 bytes are written in small records
+  echo(0x10000);
+  CHECK(client.statistics().small_records_encrypted == 5);
+  CHECK(client.statistics().records_encrypted == 5 + 4);
+
+  echo(2000);
+  CHECK(client.statistics().small_records_encrypted == 5);
+  CHECK(client.statistics().records_encrypted == 5 + 4 + 1);
+  CHECK(client.statistics().record_sizing_resets == 0);
+
+  // Small records are used again after being idle
+  std::this_thread::sleep_for(std::chrono::milliseconds(400));
+  echo(2000);
+  CHECK(client.statistics().small_records_encrypted == 7);
+  CHECK(client.statistics().records_encrypted == 5 + 4 + 1 + 2);
+  CHECK(client.statistics().record_sizing_resets == 1);
+
+  // Corked records are filled up to the size of the small records
+  client.set_record_sizing(sizing);
+  client.set_cork(true);
+  const std::string corked_data = generate_data(1500);
+  net::write(client, net::buffer(corked_data));
+  client.flush();
+  std::string received(corked_data.size(), '\0');
+  net::read(server, net::buffer(received));
+  CHECK(received == corked_data);
+  CHECK(client.statistics().small_records_encrypted == 9);
+  CHECK(client.statistics().records_encrypted == 5 + 4 + 1 + 2 + 2);
+
+  // Disabled by a ramp up size of zero
+  sizing.ramp_up_size = 0;
+  client.set_record_sizing(sizing);
+  client.set_cork(false);
+  echo(2000);
+  CHECK(client.statistics().small_records_encrypted == 9);
+  CHECK(client.statistics().records_encrypted == 5 + 4 + 1 + 2 + 2 + 1);
+}
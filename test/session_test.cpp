@@ -0,0 +1,231 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "certificate.hpp"
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+using wintls::test::loopback_fixture;
+using wintls::test::loopback_provider;
+
+TEST_CASE_METHOD(loopback_fixture, "client sessions") {
+  auto resumed = [&](const std::string& hostname, std::uint16_t port) {
+    wintls::stream<test_stream> client(io_context, client_ctx);
+    wintls::stream<test_stream> server(io_context, server_ctx);
+    client.set_server_hostname(hostname);
+    client.set_server_port(port);
+    connect(client, server);
+    return client.session_resumed();
+  };
+
+  SECTION("shared credentials") {
+    CHECK_FALSE(resumed("a.example", 443));
+    CHECK(resumed("a.example", 443));
+    CHECK(resumed("a.example", 8443));
+    CHECK_FALSE(resumed("b.example", 443));
+    CHECK(loopback_provider::statistics().credentials_acquired == 2);
+  }
+
+  SECTION("credentials per server") {
+    client_ctx.set_session_cache_size(2);
+    CHECK_FALSE(resumed("a.example", 443));
+    CHECK(resumed("a.example", 443));
+    CHECK_FALSE(resumed("a.example", 8443));
+    CHECK(resumed("a.example", 8443));
+    CHECK(loopback_provider::statistics().credentials_acquired == 3);
+
+    // The least recently used server is evicted
+    CHECK(resumed("a.example", 443));
+    CHECK_FALSE(resumed("b.example", 443));
+    CHECK(resumed("a.example", 443));
+    CHECK_FALSE(resumed("a.example", 8443));
+    CHECK(loopback_provider::statistics().credentials_acquired == 5);
+  }
+
+  CHECK(loopback_provider::statistics().sessions_resumed > 0);
+}
+
+TEST_CASE_METHOD(loopback_fixture, "concurrent sessions") {
+  // Streams on different threads share the sessions of the same
+  // credentials. Assertions are only made once all threads are done
+  // as Catch is not thread safe.
+  std::atomic<std::size_t> failures{0};
+  std::atomic<std::size_t> resumptions{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&, i]() {
+      net::io_context thread_io_context;
+      for (int j = 0; j < 20; ++j) {
+        wintls::stream<test_stream> client(thread_io_context, client_ctx);
+        wintls::stream<test_stream> server(thread_io_context, server_ctx);
+        client.set_server_hostname((i + j) % 2 == 0 ? "a.example" : "b.example");
+        client.next_layer().connect(server.next_layer());
+        error_code client_ec{};
+        error_code server_ec{};
+        client.async_handshake(wintls::handshake_type::client, [&client_ec](const error_code& ec) {
+          client_ec = ec;
+        });
+        server.async_handshake(wintls::handshake_type::server, [&server_ec](const error_code& ec) {
+          server_ec = ec;
+        });
+        thread_io_context.run();
+        thread_io_context.restart();
+        if (client_ec || server_ec || client.session_resumed() != server.session_resumed()) {
+          ++failures;
+        }
+        if (client.session_resumed()) {
+          ++resumptions;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  CHECK(failures == 0);
+  CHECK(resumptions > 0);
+}
+
+TEST_CASE_METHOD(loopback_fixture, "server sessions") {
+  auto resumed = [&](wintls::context& ctx) {
+    wintls::stream<test_stream> client(io_context, client_ctx);
+    wintls::stream<test_stream> server(io_context, ctx);
+    client.set_server_hostname("a.example");
+    connect(client, server);
+    CHECK(client.session_resumed() == server.session_resumed());
+    CHECK(server.statistics().handshakes == 1);
+    CHECK(server.statistics().sessions_resumed == (server.session_resumed() ? 1u : 0u));
+    return server.session_resumed();
+  };
+
+  SECTION("resumption") {
+    CHECK_FALSE(resumed(server_ctx));
+    CHECK(resumed(server_ctx));
+  }
+
+  SECTION("resumption disabled") {
+    server_ctx.allow_session_resumption(false);
+    CHECK_FALSE(resumed(server_ctx));
+    CHECK_FALSE(resumed(server_ctx));
+  }
+
+  SECTION("session lifetime") {
+    server_ctx.set_session_lifetime(std::chrono::milliseconds(1));
+    CHECK_FALSE(resumed(server_ctx));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    CHECK_FALSE(resumed(server_ctx));
+  }
+
+  SECTION("session lifetime out of range") {
+    error_code ec{};
+    server_ctx.set_session_lifetime(std::chrono::milliseconds(-1), ec);
+    CHECK(ec.value() == SEC_E_INVALID_PARAMETER);
+    CHECK_THROWS(server_ctx.set_session_lifetime(std::chrono::milliseconds(-1)));
+
+    // Lifetimes longer than supported are reduced to the longest
+    // supported lifetime instead of wrapping around
+    server_ctx.set_session_lifetime(std::chrono::milliseconds(0x100000001));
+    CHECK_FALSE(resumed(server_ctx));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    CHECK(resumed(server_ctx));
+  }
+
+  SECTION("not shared between contexts") {
+    wintls::context other_ctx(wintls::method::system_default);
+    CHECK_FALSE(resumed(server_ctx));
+    CHECK_FALSE(resumed(other_ctx));
+  }
+
+  SECTION("shared between contexts") {
+    wintls::context other_ctx(wintls::method::system_default);
+    other_ctx.share_sessions_with(server_ctx);
+    CHECK_FALSE(resumed(server_ctx));
+    CHECK(resumed(other_ctx));
+  }
+}
+
+namespace {
+
+// Server contexts sharing sessions, using certificates with the same
+// imported private key
+struct shared_sessions : loopback_fixture {
+  shared_sessions() {
+    error_code dummy;
+    wintls::delete_private_key(key_name, dummy);
+    wintls::import_private_key(net::buffer(test_key), wintls::file_format::pem, key_name);
+    other_ctx.share_sessions_with(server_ctx);
+  }
+
+  ~shared_sessions() {
+    error_code dummy;
+    wintls::delete_private_key(key_name, dummy);
+  }
+
+  wintls::cert_context_ptr make_certificate() {
+    auto cert = wintls::x509_to_cert_context(net::buffer(test_certificate), wintls::file_format::pem);
+    wintls::assign_private_key(cert.get(), key_name);
+    return cert;
+  }
+
+  void connect_to(wintls::context& ctx) {
+    wintls::stream<test_stream> client(io_context, client_ctx);
+    wintls::stream<test_stream> server(io_context, ctx);
+    connect(client, server);
+  }
+
+  const std::string key_name = test_key_name + "-loopback";
+  wintls::context other_ctx{wintls::method::system_default};
+};
+
+} // namespace
+
+TEST_CASE_METHOD(shared_sessions, "shared sessions certificate changed") {
+  server_ctx.use_certificate(make_certificate().get());
+  other_ctx.use_certificate(make_certificate().get());
+
+  connect_to(server_ctx);
+  connect_to(other_ctx);
+  CHECK(loopback_provider::statistics().credentials_acquired == 3);
+
+  // Only the credentials of the replaced certificate are acquired again
+  other_ctx.use_certificate(make_certificate().get());
+  connect_to(server_ctx);
+  CHECK(loopback_provider::statistics().credentials_acquired == 3);
+  connect_to(other_ctx);
+  CHECK(loopback_provider::statistics().credentials_acquired == 4);
+}
+
+TEST_CASE_METHOD(shared_sessions, "shared sessions context destroyed") {
+  server_ctx.use_certificate(make_certificate().get());
+  connect_to(server_ctx);
+  {
+    wintls::context destroyed_ctx(wintls::method::system_default);
+    destroyed_ctx.use_certificate(make_certificate().get());
+    destroyed_ctx.share_sessions_with(server_ctx);
+    connect_to(destroyed_ctx);
+  }
+  CHECK(loopback_provider::statistics().credentials_acquired == 3);
+
+  // The credentials of the destroyed context are never used for the
+  // certificate of another context, even if the certificate of the
+  // destroyed context has been freed and its memory reused
+  for (int i = 0; i < 2; ++i) {
+    wintls::context ctx(wintls::method::system_default);
+    ctx.use_certificate(make_certificate().get());
+    ctx.share_sessions_with(server_ctx);
+    connect_to(ctx);
+    CHECK(loopback_provider::statistics().credentials_acquired == 4 + static_cast<std::size_t>(i));
+  }
+}
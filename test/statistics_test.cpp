@@ -0,0 +1,50 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls.hpp>
+
+#include <array>
+#include <string>
+
+using wintls::test::generate_data;
+using wintls::test::loopback_connection;
+
+TEST_CASE_METHOD(loopback_connection, "stream statistics") {
+  CHECK(client.statistics().handshake_round_trips > 0);
+  CHECK(client.statistics().handshake_time.count() > 0);
+  CHECK(server.statistics().handshake_time.count() > 0);
+
+  const std::string test_data = generate_data(0x10000 + 1);
+  net::write(client, net::buffer(test_data));
+
+  // Read using a buffer smaller than a record, leaving decrypted data
+  // for the following reads
+  std::string received;
+  std::array<char, 0x100> buffer;
+  while (received.size() < test_data.size()) {
+    const auto size = server.read_some(net::buffer(buffer));
+    received.append(buffer.data(), size);
+  }
+  CHECK(received == test_data);
+
+  const auto client_stats = client.statistics();
+  const auto server_stats = server.statistics();
+  CHECK(client_stats.plaintext_bytes_written == test_data.size());
+  CHECK(client_stats.plaintext_bytes_copied == test_data.size());
+  CHECK(client_stats.records_encrypted == 5);
+  CHECK(server_stats.plaintext_bytes_read == test_data.size());
+  CHECK(server_stats.records_decrypted == 5);
+  CHECK(server_stats.decrypted_data_spills > 0);
+  // Spilled data is copied both into the stream and out of it again
+  CHECK(server_stats.plaintext_bytes_copied > test_data.size());
+  CHECK(server_stats.plaintext_bytes_copied < 2 * test_data.size());
+  CHECK(server_stats.ciphertext_bytes_read == client_stats.ciphertext_bytes_written);
+  CHECK(client_stats.ciphertext_bytes_read == server_stats.ciphertext_bytes_written);
+  CHECK(client_stats.next_layer_writes > 0);
+  CHECK(server_stats.next_layer_reads > 0);
+}
@@ -12,6 +12,7 @@
 
 #include "service_base.hpp"
 #include "is_invocable.hpp"
+#include <wintls/detail/bind_handler.hpp>
 #include <mutex>
 #include <stdexcept>
 #include <vector>
@@ -114,10 +115,9 @@ class stream::read_op : public stream::read_op_base
                 }
             }
 
-            auto alloc = net::get_associated_allocator(h_);
-            wg2_.get_executor().dispatch(
-                std::bind(std::move(h_),
-                    ec, bytes_transferred), alloc);
+            net::dispatch(wg2_.get_executor(),
+                wintls::detail::bind_handler(std::move(h_),
+                    ec, bytes_transferred));
             wg2_.reset();
         }
     };
@@ -201,11 +201,16 @@ struct stream::run_write_op
             "WriteHandler type requirements not met");
 
         ++in_->nwrite;
+        // Dispatch to the executor associated with the handler as
+        // std::bind does not forward the associated executor
         auto const upcall = [&](error_code ec, std::size_t n)
         {
+            auto const ex = net::get_associated_executor(
+                h, in_->ioc.get_executor());
             net::post(
                 in_->ioc.get_executor(),
-                std::bind(std::move(h), ec, n));
+                net::bind_executor(ex,
+                    std::bind(std::move(h), ec, n)));
         };
 
         // test failure
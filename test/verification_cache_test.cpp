@@ -0,0 +1,74 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "unittest.hpp"
+
+#include <wintls/detail/verification_cache.hpp>
+
+#include <chrono>
+
+using wintls::detail::verification_cache;
+
+TEST_CASE("verification cache") {
+  verification_cache cache;
+  const auto now = verification_cache::clock::now();
+
+  SECTION("disabled by default") {
+    CHECK_FALSE(cache.enabled());
+    cache.insert("leaf", now);
+    CHECK(cache.size() == 0);
+    CHECK_FALSE(cache.find("leaf", now));
+  }
+
+  cache.configure(2, std::chrono::seconds(60));
+  REQUIRE(cache.enabled());
+
+  SECTION("hits and misses") {
+    CHECK_FALSE(cache.find("leaf", now));
+    cache.insert("leaf", now);
+    CHECK(cache.find("leaf", now));
+    CHECK(cache.find("leaf", now + std::chrono::seconds(1)));
+    CHECK_FALSE(cache.find("other", now));
+    CHECK(cache.hits() == 2);
+    CHECK(cache.misses() == 2);
+  }
+
+  SECTION("least recently used entry is evicted") {
+    cache.insert("first", now);
+    cache.insert("second", now);
+    CHECK(cache.find("first", now));
+    cache.insert("third", now);
+    CHECK(cache.size() == 2);
+    CHECK(cache.find("first", now));
+    CHECK_FALSE(cache.find("second", now));
+    CHECK(cache.find("third", now));
+  }
+
+  SECTION("entries expire") {
+    cache.insert("leaf", now);
+    CHECK(cache.find("leaf", now + std::chrono::seconds(59)));
+    CHECK_FALSE(cache.find("leaf", now + std::chrono::seconds(60)));
+    CHECK(cache.size() == 0);
+
+    // Inserting an existing entry again renews it
+    cache.insert("leaf", now);
+    cache.insert("leaf", now + std::chrono::seconds(30));
+    CHECK(cache.size() == 1);
+    CHECK(cache.find("leaf", now + std::chrono::seconds(80)));
+  }
+
+  SECTION("clear and disable") {
+    cache.insert("first", now);
+    cache.insert("second", now);
+    cache.clear();
+    CHECK(cache.size() == 0);
+    CHECK_FALSE(cache.find("first", now));
+
+    cache.insert("first", now);
+    cache.configure(0, std::chrono::seconds(60));
+    CHECK_FALSE(cache.enabled());
+    CHECK(cache.size() == 0);
+  }
+}
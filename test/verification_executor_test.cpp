@@ -0,0 +1,75 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "certificate.hpp"
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+using wintls::test::loopback_fixture;
+using wintls::test::loopback_provider;
+
+TEST_CASE("verification executor") {
+  const auto cert = wintls::x509_to_cert_context(net::buffer(test_certificate), wintls::file_format::pem);
+  loopback_provider::options opts;
+  opts.remote_certificate = cert.get();
+  opts.remote_certificate_delay = std::chrono::milliseconds(500);
+  loopback_fixture fixture(opts);
+  auto& io_context = fixture.io_context;
+
+  net::thread_pool verification_pool(1);
+  fixture.client_ctx.verify_server_certificate(true);
+  fixture.client_ctx.add_certificate_authority(cert.get());
+
+  wintls::stream<test_stream> client(io_context, fixture.client_ctx);
+  wintls::stream<test_stream> server(io_context, fixture.server_ctx);
+  client.set_verification_executor(verification_pool.get_executor());
+  client.next_layer().connect(server.next_layer());
+
+  // Measure the longest time the I/O thread is unable to run a timer
+  // while the client is verifying the certificate
+  using clock = std::chrono::steady_clock;
+  net::steady_timer timer(io_context);
+  bool handshake_done = false;
+  auto last_tick = clock::now();
+  clock::duration max_gap{0};
+  std::function<void()> tick = [&]() {
+    timer.expires_after(std::chrono::milliseconds(10));
+    timer.async_wait([&](const error_code&) {
+      const auto now = clock::now();
+      max_gap = std::max(max_gap, now - last_tick);
+      last_tick = now;
+      if (!handshake_done) {
+        tick();
+      }
+    });
+  };
+  tick();
+
+  const auto io_thread = std::this_thread::get_id();
+  auto completion_thread = std::thread::id{};
+  error_code client_ec{};
+  error_code server_ec{};
+  client.async_handshake(wintls::handshake_type::client, [&](const error_code& ec) {
+    client_ec = ec;
+    completion_thread = std::this_thread::get_id();
+    handshake_done = true;
+  });
+  server.async_handshake(wintls::handshake_type::server, [&server_ec](const error_code& ec) {
+    server_ec = ec;
+  });
+  io_context.run();
+
+  CHECK_FALSE(client_ec);
+  CHECK_FALSE(server_ec);
+  CHECK(completion_thread == io_thread);
+  CHECK(max_gap < opts.remote_certificate_delay / 2);
+}
@@ -0,0 +1,82 @@
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "loopback_provider.hpp"
+#include "unittest.hpp"
+
+#include <wintls.hpp>
+
+#include <array>
+#include <memory>
+#include <string>
+
+using wintls::test::generate_data;
+using wintls::test::loopback_fixture;
+
+TEST_CASE_METHOD(loopback_fixture, "wait") {
+  using tcp = net::ip::tcp;
+
+  auto pool = std::make_shared<wintls::buffer_pool>();
+  server_ctx.use_buffer_pool(pool);
+  wintls::stream<tcp::socket> client(io_context, client_ctx);
+  wintls::stream<tcp::socket> server(io_context, server_ctx);
+
+  // The test stream cannot wait, so connect over TCP instead
+  tcp::acceptor acceptor(io_context, tcp::endpoint(net::ip::address_v4::loopback(), 0));
+  client.next_layer().connect(acceptor.local_endpoint());
+  acceptor.accept(server.next_layer());
+  handshake(client, server);
+  server.set_release_idle_buffers(true);
+
+  bool waited = false;
+  auto wait = [&]() {
+    waited = false;
+    server.async_wait(net::socket_base::wait_read, [&waited](const error_code& ec) {
+      REQUIRE_FALSE(ec);
+      waited = true;
+    });
+    io_context.poll();
+    io_context.restart();
+  };
+
+  std::array<char, 0x100> buffer;
+  const std::string test_data = generate_data(2 * buffer.size());
+  std::string received;
+
+  // Waits on the next layer with nothing received
+  wait();
+  CHECK_FALSE(waited);
+  net::write(client, net::buffer(test_data));
+  io_context.run();
+  io_context.restart();
+  CHECK(waited);
+
+  // Completes with the rest of the record already decrypted
+  received.append(buffer.data(), server.read_some(net::buffer(buffer)));
+  const auto next_layer_reads = server.statistics().next_layer_reads;
+  wait();
+  CHECK(waited);
+  received.append(buffer.data(), server.read_some(net::buffer(buffer)));
+  CHECK(received == test_data);
+  CHECK(server.statistics().next_layer_reads == next_layer_reads);
+
+  // The buffers of the stream are released while waiting
+  const auto free_buffers = pool->free_buffers();
+  wait();
+  CHECK_FALSE(waited);
+  CHECK(pool->free_buffers() > free_buffers);
+  net::write(client, net::buffer(test_data));
+  io_context.run();
+  io_context.restart();
+  CHECK(waited);
+
+  // Synchronous waits and waits for writing
+  server.wait(net::socket_base::wait_read);
+  server.wait(net::socket_base::wait_write);
+  received.clear();
+  received.resize(test_data.size());
+  net::read(server, net::buffer(received));
+  CHECK(received == test_data);
+}